@@ -2,4 +2,5 @@
 #define PROCRANK_H_
 
 int procrank_main(int argc, char **argv, int fd);
+int librank_main(int argc, char **argv, int fd);
 #endif
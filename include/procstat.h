@@ -0,0 +1,47 @@
+#ifndef PROCSTAT_H_
+#define PROCSTAT_H_
+
+#include <sys/types.h>
+
+/*
+ * /proc/stat, read at most once per clock tick and parsed once for all
+ * its users (mpstat, iostat, top, irq_info, GetProcStat).  Each user gets
+ * its own copy, in a struct procstat it owns.
+ */
+
+/* Jiffies of one "cpu" line */
+struct procstat_cpu {
+	unsigned long long user;
+	unsigned long long nice;
+	unsigned long long system;
+	unsigned long long idle;
+	unsigned long long iowait;
+	unsigned long long irq;
+	unsigned long long softirq;
+	unsigned long long steal;
+	unsigned long long guest;
+	unsigned long long guest_nice;
+};
+
+struct procstat {
+	/* cpu[0] is the "cpu" line, cpu[1 + N] the "cpuN" line.  Offline
+	 * CPUs below the highest online one are left zeroed. */
+	struct procstat_cpu *cpu;
+	int nr_cpu;
+	int cpu_alloc;
+	unsigned long long intr;	/* interrupts since boot */
+	unsigned long long ctxt;	/* context switches since boot */
+	unsigned long long btime;
+	unsigned long long processes;	/* forks since boot */
+	unsigned long long procs_running;
+	unsigned long long procs_blocked;
+	unsigned long long softirq;	/* softirqs since boot */
+};
+
+/* Copy the current snapshot into @ps; 0 on success, -1 on error */
+int procstat_get(struct procstat *ps);
+/* Copy the text of the current snapshot into @buf, NUL-terminated */
+ssize_t procstat_text(char *buf, size_t size);
+void procstat_free(struct procstat *ps);
+
+#endif
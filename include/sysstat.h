@@ -4,4 +4,6 @@
 int iostat_main(int argc, char **argv, int fd);
 int mpstat_main(int argc, char **argv, int fd);
 int cpuinfo_main(int argc, char **argv, int out_fd);
+int irqstat_main(int argc, char **argv, int fd);
+int diskstat_main(int argc, char **argv, int fd);
 #endif
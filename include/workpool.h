@@ -0,0 +1,32 @@
+#ifndef WORKPOOL_H_
+#define WORKPOOL_H_
+
+#include <stddef.h>
+
+/*
+ * A few threads sharing the items [0, n) of one job: each worker claims
+ * the next chunk with an atomic add until none are left.  procrank's
+ * per-process page walks, the ps /proc scan and top's smaps reads all
+ * run on it.
+ */
+
+#define WORKPOOL_MAX_WORKERS	64
+
+struct workpool {
+	size_t n;		/* items in the job */
+	size_t chunk;		/* items claimed at a time */
+	size_t next;		/* first unclaimed item */
+	/* Body of worker @w, 0 <= w < nworkers; loops on workpool_next() */
+	void (*worker)(struct workpool *wp, int w);
+	void *arg;		/* for the worker */
+};
+
+/* Workers worth starting for @n items: one per online CPU, at most @max,
+ * one more only for every @min_items items, and never more than @n */
+int workpool_size(size_t n, int max, size_t min_items);
+/* Claim the next chunk as [*begin, *end); 0 when the job is done */
+int workpool_next(struct workpool *wp, size_t *begin, size_t *end);
+/* Run @nworkers workers, worker 0 on the calling thread, and wait for them */
+void workpool_run(struct workpool *wp, int nworkers);
+
+#endif
@@ -1540,6 +1540,9 @@ typedef struct procps_status_t {
 	IF_FEATURE_SHOW_THREADS(DIR *task_dir;)
 	uint8_t shift_pages_to_bytes;
 	uint8_t shift_pages_to_kb;
+	/* set by the caller: at the end of a scan rewind instead of freeing,
+	 * so the same handle (and its /proc DIR) serves the next scan */
+	uint8_t reuse;
 /* Fields are set to 0/NULL if failed to determine (or not requested) */
 	uint16_t argv_len;
 	char *argv0;
@@ -1608,9 +1611,11 @@ enum {
 	PSSCAN_RUIDGID  = (1 << 21) * ENABLE_FEATURE_PS_ADDITIONAL_COLUMNS,
 	PSSCAN_TASKS	= (1 << 22) * ENABLE_FEATURE_SHOW_THREADS,
 };
-//procps_status_t* alloc_procps_scan(void) FAST_FUNC;
+procps_status_t* alloc_procps_scan(void) FAST_FUNC;
 void free_procps_scan(procps_status_t* sp) FAST_FUNC;
 procps_status_t* procps_scan(procps_status_t* sp, int flags) FAST_FUNC;
+int proc_dirfd(void) FAST_FUNC;
+ssize_t proc_read_close(const char *name, void *buf, size_t size) FAST_FUNC;
 /* Format cmdline (up to col chars) into char buf[size] */
 /* Puts [comm] if cmdline is empty (-> process is a kernel thread) */
 void read_cmdline(char *buf, int size, unsigned pid, const char *comm) FAST_FUNC;
@@ -9,6 +9,7 @@
  * Licensed under GPLv2 or later, see file LICENSE in this source tree.
  */
 
+#define _GNU_SOURCE  /* strchrnul; undeclared it returns a truncated int */
 #include "libbb.h"
 
 typedef struct id_to_name_map_t {
@@ -77,26 +78,51 @@ const char* FAST_FUNC get_cached_groupname(gid_t gid)
 
 #define PROCPS_BUFSIZE 1024
 
+/* /proc is opened once; everything below it is reached with openat(),
+ * which saves the kernel a path walk from / and lets callers use short
+ * "PID/stat" names instead of the full path */
+int FAST_FUNC proc_dirfd(void)
+{
+	static int proc_fd = -1;
+
+	if (proc_fd < 0) {
+		int fd = xopen("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (!__sync_bool_compare_and_swap(&proc_fd, -1, fd))
+			close(fd); /* another applet got there first */
+	}
+	return proc_fd;
+}
+
+/* open_read_close() for a name relative to /proc, e.g. "meminfo" */
+ssize_t FAST_FUNC proc_read_close(const char *name, void *buf, size_t size)
+{
+	ssize_t ret;
+	int fd = openat(proc_dirfd(), name, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return fd;
+	ret = read(fd, buf, size);
+	close(fd);
+	return ret;
+}
+
 static int read_to_buf(const char *filename, void *buf)
 {
-	int fd;
 	/* open_read_close() would do two reads, checking for EOF.
 	 * When you have 10000 /proc/$NUM/stat to read, it isn't desirable */
-	ssize_t ret = -1;
-	fd = open(filename, O_RDONLY);
-	if (fd >= 0) {
-		ret = read(fd, buf, PROCPS_BUFSIZE-1);
-		close(fd);
-	}
+	ssize_t ret = proc_read_close(filename, buf, PROCPS_BUFSIZE-1);
 	((char *)buf)[ret > 0 ? ret : 0] = '\0';
 	return ret;
 }
 
-static procps_status_t* FAST_FUNC alloc_procps_scan(void)
+procps_status_t* FAST_FUNC alloc_procps_scan(void)
 {
 	unsigned n = getpagesize();
 	procps_status_t* sp = xzalloc(sizeof(procps_status_t));
-	sp->dir = xopendir("/proc");
+	/* own fd: the readdir position must not be shared */
+	sp->dir = fdopendir(openat(proc_dirfd(), ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+	if (!sp->dir)
+		bb_perror_msg_and_die("can't open '%s'", "/proc");
 	while (1) {
 		n >>= 1;
 		if (!n) break;
@@ -178,110 +204,201 @@ static char *skip_fields(char *str, int count)
 #endif
 
 #if ENABLE_FEATURE_TOPMEM || ENABLE_PMAP
+/* The smaps keys we sum. A key line is matched on its whole "Key:" prefix,
+ * so the ~20 keys we do not want cost one length compare each.
+ */
+static const struct smaps_key {
+	char name[15];
+	uint8_t len;
+	uint8_t cb_only;        /* only per-mapping callers (pmap) want it */
+	uint8_t offset;         /* in struct smaprec */
+} smaps_keys[] = {
+#define KEY(S, X, cb_only) { S, sizeof(S)-1, cb_only, offsetof(struct smaprec, X) }
+	KEY("Private_Dirty:", private_dirty, 0),
+	KEY("Private_Clean:", private_clean, 0),
+	KEY("Shared_Dirty:" , shared_dirty , 0),
+	KEY("Shared_Clean:" , shared_clean , 0),
+	KEY("Pss:"          , smap_pss     , 1),
+	KEY("Swap:"         , smap_swap    , 1),
+#undef KEY
+};
+
+typedef struct smaps_state {
+	struct smaprec *total;
+	struct smaprec currec;
+	void (*cb)(struct smaprec *, void *);
+	void *data;
+} smaps_state;
+
+/* "Rss:    nnn kB" */
+static void smaps_key_line(char *line, smaps_state *st)
+{
+	const struct smaps_key *k;
+	unsigned len = skip_non_whitespace(line) - line;
+
+	for (k = smaps_keys; k < smaps_keys + ARRAY_SIZE(smaps_keys); k++) {
+		if (k->len == len && memcmp(line, k->name, len) == 0) {
+			unsigned long v;
+
+			if (k->cb_only && !st->cb)
+				return;
+			line = skip_whitespace(line + len);
+			v = fast_strtoul_10(&line);
+			*(unsigned long *)((char *)&st->currec + k->offset) = v;
+			*(unsigned long *)((char *)st->total + k->offset) += v;
+			return;
+		}
+	}
+}
+
+/* f7d29000-f7d39000 rw-s FILEOFS M:m INODE FILENAME */
+static void smaps_map_line(char *line, smaps_state *st)
+{
+	struct smaprec *total = st->total;
+	char *tp, *p;
+	int i;
+
+	if (st->cb) {
+		/* If we have a previous record, there's nothing more
+		 * for it, call the callback and clear currec
+		 */
+		if (st->currec.smap_size)
+			st->cb(&st->currec, st->data);
+		free(st->currec.smap_name);
+	}
+	memset(&st->currec, 0, sizeof(st->currec));
+
+	tp = strchr(line, '-');
+	if (!tp)
+		return;
+	*tp = ' ';
+	tp = line;
+	st->currec.smap_start = fast_strtoul_16(&tp);
+	st->currec.smap_size = (fast_strtoul_16(&tp) - st->currec.smap_start) >> 10;
+
+	strncpy(st->currec.smap_mode, tp, sizeof(st->currec.smap_mode)-1);
+
+	/* skipping "rw-s FILEOFS M:m INODE ": anonymous mappings
+	 * end right after INODE, so stop at the end of the line */
+	for (i = 0; i < 4; i++)
+		tp = skip_whitespace(skip_non_whitespace(tp));
+	// filter out /dev/something (something != zero)
+	if (strncmp(tp, "/dev/", 5) != 0 || strcmp(tp, "/dev/zero") == 0) {
+		if (st->currec.smap_mode[1] == 'w') {
+			st->currec.mapped_rw = st->currec.smap_size;
+			total->mapped_rw += st->currec.smap_size;
+		} else if (st->currec.smap_mode[1] == '-') {
+			st->currec.mapped_ro = st->currec.smap_size;
+			total->mapped_ro += st->currec.smap_size;
+		}
+	}
+
+	if (strcmp(tp, "[stack]") == 0)
+		total->stack += st->currec.smap_size;
+	if (st->cb) {
+		p = skip_non_whitespace(tp);
+		if (p == tp) {
+			st->currec.smap_name = xstrdup("  [ anon ]");
+		} else {
+			*p = '\0';
+			st->currec.smap_name = xstrdup(tp);
+		}
+	}
+	total->smap_size += st->currec.smap_size;
+}
+
+static void smaps_line(char *line, smaps_state *st, int keys_only)
+{
+	/* key lines start with a capital, mapping lines with hex */
+	if (line[0] >= 'A' && line[0] <= 'Z')
+		smaps_key_line(line, st);
+	else if (!keys_only)
+		smaps_map_line(line, st);
+}
+
+/* Feed the lines of /proc/NAME to the parsers, NUL-terminated without
+ * their '\n'. Reads in large blocks: stdio's per-line fgets() shows up
+ * on processes with thousands of mappings.
+ */
+static int smaps_read_lines(const char *name, smaps_state *st, int keys_only)
+{
+	char buf[16 * 1024];
+	unsigned have = 0;
+	ssize_t n;
+	int fd = openat(proc_dirfd(), name, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return 1;
+	while ((n = read(fd, buf + have, sizeof(buf) - 1 - have)) > 0) {
+		char *line = buf, *nl;
+		char *end = buf + have + n;
+
+		while ((nl = memchr(line, '\n', end - line)) != NULL) {
+			*nl = '\0';
+			smaps_line(line, st, keys_only);
+			line = nl + 1;
+		}
+		have = end - line;
+		if (have == sizeof(buf) - 1)
+			have = 0; /* no line is this long; drop it */
+		memmove(buf, line, have);
+	}
+	close(fd);
+	if (have) {
+		buf[have] = '\0';
+		smaps_line(buf, st, keys_only);
+	}
+	return 0;
+}
+
 int FAST_FUNC procps_read_smaps(pid_t pid, struct smaprec *total,
 		void (*cb)(struct smaprec *, void *), void *data)
 {
-	FILE *file;
-	struct smaprec currec;
-	char filename[sizeof("/proc/%u/smaps") + sizeof(int)*3];
-	char buf[PROCPS_BUFSIZE];
+	/* smaps_rollup (Linux 4.14) sums the counters in the kernel */
+	static int have_rollup = -1;
+	char filename[sizeof("%u/smaps_rollup") + sizeof(int)*3];
+	smaps_state st;
 #if !ENABLE_PMAP
 	void (*cb)(struct smaprec *, void *) = NULL;
 	void *data = NULL;
 #endif
 
-	sprintf(filename, "/proc/%u/smaps", (int)pid);
+	memset(&st, 0, sizeof(st));
+	st.total = total;
+	st.cb = cb;
+	st.data = data;
 
-	file = fopen_for_read(filename);
-	if (!file)
-		return 1;
-
-	memset(&currec, 0, sizeof(currec));
-	while (fgets(buf, PROCPS_BUFSIZE, file)) {
-		// Each mapping datum has this form:
-		// f7d29000-f7d39000 rw-s FILEOFS M:m INODE FILENAME
-		// Size:                nnn kB
-		// Rss:                 nnn kB
-		// .....
-
-		char *tp = buf, *p;
-
-#define SCAN(S, X) \
-		if (strncmp(tp, S, sizeof(S)-1) == 0) {              \
-			tp = skip_whitespace(tp + sizeof(S)-1);      \
-			total->X += currec.X = fast_strtoul_10(&tp); \
-			continue;                                    \
-		}
-		if (cb) {
-			SCAN("Pss:"  , smap_pss     );
-			SCAN("Swap:" , smap_swap    );
-		}
-		SCAN("Private_Dirty:", private_dirty);
-		SCAN("Private_Clean:", private_clean);
-		SCAN("Shared_Dirty:" , shared_dirty );
-		SCAN("Shared_Clean:" , shared_clean );
-#undef SCAN
-		tp = strchr(buf, '-');
-		if (tp) {
-			// We reached next mapping - the line of this form:
-			// f7d29000-f7d39000 rw-s FILEOFS M:m INODE FILENAME
-
-			if (cb) {
-				/* If we have a previous record, there's nothing more
-				 * for it, call the callback and clear currec
-				 */
-				if (currec.smap_size)
-					cb(&currec, data);
-				free(currec.smap_name);
-			}
-			memset(&currec, 0, sizeof(currec));
-
-			*tp = ' ';
-			tp = buf;
-			currec.smap_start = fast_strtoul_16(&tp);
-			currec.smap_size = (fast_strtoul_16(&tp) - currec.smap_start) >> 10;
-
-			strncpy(currec.smap_mode, tp, sizeof(currec.smap_mode)-1);
-
-			// skipping "rw-s FILEOFS M:m INODE "
-			tp = skip_whitespace(skip_fields(tp, 4));
-			// filter out /dev/something (something != zero)
-			if (strncmp(tp, "/dev/", 5) != 0 || strcmp(tp, "/dev/zero\n") == 0) {
-				if (currec.smap_mode[1] == 'w') {
-					currec.mapped_rw = currec.smap_size;
-					total->mapped_rw += currec.smap_size;
-				} else if (currec.smap_mode[1] == '-') {
-					currec.mapped_ro = currec.smap_size;
-					total->mapped_ro += currec.smap_size;
-				}
-			}
-
-			if (strcmp(tp, "[stack]\n") == 0)
-				total->stack += currec.smap_size;
-			if (cb) {
-				p = skip_non_whitespace(tp);
-				if (p == tp) {
-					currec.smap_name = xstrdup("  [ anon ]");
-				} else {
-					*p = '\0';
-					currec.smap_name = xstrdup(tp);
-				}
-			}
-			total->smap_size += currec.smap_size;
-		}
+	if (have_rollup < 0)
+		have_rollup = faccessat(proc_dirfd(), "self/smaps_rollup", R_OK, 0) == 0;
+	if (!cb && have_rollup) {
+		/* Only totals wanted: take the counters from smaps_rollup,
+		 * and sizes and modes from maps, which needs no page walk.
+		 */
+		sprintf(filename, "%u/smaps_rollup", (int)pid);
+		if (smaps_read_lines(filename, &st, 1))
+			return 1;
+		sprintf(filename, "%u/maps", (int)pid);
+		smaps_read_lines(filename, &st, 0);
+		return 0;
 	}
-	fclose(file);
+
+	sprintf(filename, "%u/smaps", (int)pid);
+	if (smaps_read_lines(filename, &st, 0))
+		return 1;
 
 	if (cb) {
-		if (currec.smap_size)
-			cb(&currec, data);
-		free(currec.smap_name);
+		if (st.currec.smap_size)
+			cb(&st.currec, data);
+		free(st.currec.smap_name);
 	}
 
 	return 0;
 }
 #endif
 
+/* "/proc/PID/stat" -> "PID/stat", for openat(proc_dirfd(), ...) */
+#define PROC_REL(filename) ((filename) + sizeof("/proc/")-1)
+
 void BUG_comm_size(void);
 procps_status_t* FAST_FUNC procps_scan(procps_status_t* sp, int flags)
 {
@@ -308,7 +425,10 @@ procps_status_t* FAST_FUNC procps_scan(procps_status_t* sp, int flags)
 #endif
 		entry = readdir(sp->dir);
 		if (entry == NULL) {
-			free_procps_scan(sp);
+			if (sp->reuse) /* caller keeps it for the next scan */
+				rewinddir(sp->dir);
+			else
+				free_procps_scan(sp);
 			return NULL;
 		}
 
@@ -357,7 +477,7 @@ procps_status_t* FAST_FUNC procps_scan(procps_status_t* sp, int flags)
 
 		if (flags & PSSCAN_UIDGID) {
 			struct stat sb;
-			if (stat(filename, &sb))
+			if (fstatat(proc_dirfd(), PROC_REL(filename), &sb, 0))
 				continue; /* process probably exited */
 			/* Effective UID/GID, not real */
 			sp->uid = sb.st_uid;
@@ -379,7 +499,7 @@ procps_status_t* FAST_FUNC procps_scan(procps_status_t* sp, int flags)
 #endif
 			/* see proc(5) for some details on this */
 			strcpy(filename_tail, "stat");
-			n = read_to_buf(filename, buf);
+			n = read_to_buf(PROC_REL(filename), buf);
 			if (n < 0)
 				continue; /* process probably exited */
 			cp = strrchr(buf, ')'); /* split into "PID (cmd" and "<rest>" */
@@ -531,7 +651,7 @@ procps_status_t* FAST_FUNC procps_scan(procps_status_t* sp, int flags)
 			strcpy(filename_tail, "cmdline");
 			/* TODO: to get rid of size limits, read into malloc buf,
 			 * then realloc it down to real size. */
-			n = read_to_buf(filename, buf);
+			n = read_to_buf(PROC_REL(filename), buf);
 			if (n <= 0)
 				break;
 			if (flags & PSSCAN_ARGV0)
@@ -550,7 +670,7 @@ procps_status_t* FAST_FUNC procps_scan(procps_status_t* sp, int flags)
 			free(sp->argv0);
 			sp->argv0 = NULL;
 			strcpy(filename_tail, "cmdline");
-			n = read_to_buf(filename, buf);
+			n = read_to_buf(PROC_REL(filename), buf);
 			if (n <= 0)
 				break;
 			if (flags & PSSCAN_ARGVN) {
@@ -573,10 +693,10 @@ procps_status_t* FAST_FUNC procps_scan(procps_status_t* sp, int flags)
 void FAST_FUNC read_cmdline(char *buf, int col, unsigned pid, const char *comm)
 {
 	int sz;
-	char filename[sizeof("/proc/%u/cmdline") + sizeof(int)*3];
+	char filename[sizeof("%u/cmdline") + sizeof(int)*3];
 
-	sprintf(filename, "/proc/%u/cmdline", pid);
-	sz = open_read_close(filename, buf, col - 1);
+	sprintf(filename, "%u/cmdline", pid);
+	sz = proc_read_close(filename, buf, col - 1);
 	if (sz > 0) {
 		const char *base;
 		int comm_len;
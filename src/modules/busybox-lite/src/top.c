@@ -105,12 +105,15 @@
 //config:	  Enable 's' in top (gives lots of memory info).
 
 #include "libbb.h"
+#include "procstat.h"
+#include "workpool.h"
 
 
 typedef struct top_status_t {
 	unsigned long vsz;
 #if ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
 	unsigned long ticks;
+	unsigned long start_time; /* in ticks after boot */
 	unsigned pcpu; /* delta of ticks */
 #endif
 	unsigned pid, ppid;
@@ -134,6 +137,7 @@ typedef struct jiffy_counts_t {
    the next. Used for finding deltas. */
 typedef struct save_hist {
 	unsigned long ticks;
+	unsigned long start_time; /* tells a reused pid apart */
 	pid_t pid;
 } save_hist;
 
@@ -144,7 +148,6 @@ enum { SORT_DEPTH = 3 };
 
 
 struct globals {
-	top_status_t *top;
 	int ntop;
 	smallint inverted;
 #if ENABLE_FEATURE_TOPMEM
@@ -165,11 +168,11 @@ struct globals {
 	cmp_funcp sort_function[1];
 #else
 	cmp_funcp sort_function[SORT_DEPTH];
-	struct save_hist *prev_hist;
-	int prev_hist_count;
-	jiffy_counts_t cur_jif, prev_jif;
 	/* int hist_iterations; */
 	unsigned total_pcpu;
+	/* no history to diff against: pcpu holds lifetime averages,
+	 * already scaled to the displayed percentage */
+	smallint pcpu_lifetime;
 	/* unsigned long total_vsz; */
 #endif
 #if ENABLE_FEATURE_TOP_SMP_CPU
@@ -188,30 +191,50 @@ struct BUG_bad_size {
 	char BUG_G_too_big[sizeof(G) <= COMMON_BUFSIZE ? 1 : -1];
 	char BUG_line_buf_too_small[LINE_BUF_SIZE > 80 ? 1 : -1];
 };
-#define top              (G.top               )
 #define ntop             (G.ntop              )
 #define sort_field       (G.sort_field        )
 #define inverted         (G.inverted          )
 #define smp_cpu_info     (G.smp_cpu_info      )
 #define initial_settings (G.initial_settings  )
 #define sort_function    (G.sort_function     )
-#define prev_hist        (G.prev_hist         )
-#define prev_hist_count  (G.prev_hist_count   )
-#define cur_jif          (G.cur_jif           )
-#define prev_jif         (G.prev_jif          )
 #define cpu_jif          (G.cpu_jif           )
 #define cpu_prev_jif     (G.cpu_prev_jif      )
 #define num_cpus         (G.num_cpus          )
 #define total_pcpu       (G.total_pcpu        )
+#define pcpu_lifetime    (G.pcpu_lifetime     )
 #define line_buf         (G.line_buf          )
 #define INIT_G() do { memset(bb_common_bufsiz1, 0, sizeof(struct globals));} while (0)
 
+/* G is shared with the other applets and cleared on every call, but lepd
+ * runs top many times in one process: what should survive a call lives
+ * here instead.  The arrays only grow, to the largest process count seen,
+ * so a steady-state scan does no heap allocation.
+ */
+static struct top_persist {
+	procps_status_t *scan;          /* reused /proc walk */
+	void *rows;                     /* top_status_t or topmem_status_t */
+	unsigned rows_alloc;
+#if ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
+	struct save_hist *hist[2];      /* previous scan, the one being built */
+	unsigned hist_alloc[2];
+	int prev_hist_count;
+	jiffy_counts_t cur_jif, prev_jif;
+	struct procstat stat;           /* copy of /proc/stat */
+#endif
+} TS;
+#define top              ((top_status_t*)TS.rows)
+#define prev_hist        (TS.hist[0]          )
+#define prev_hist_count  (TS.prev_hist_count  )
+#define cur_jif          (TS.cur_jif          )
+#define prev_jif         (TS.prev_jif         )
+
 enum {
 	OPT_d = (1 << 0),
 	OPT_n = (1 << 1),
 	OPT_b = (1 << 2),
-	OPT_m = (1 << 3),
-	OPT_EOF = (1 << 4), /* pseudo: "we saw EOF in stdin" */
+	OPT_l = (1 << 3),
+	OPT_m = (1 << 4),
+	OPT_EOF = (1 << 5), /* pseudo: "we saw EOF in stdin" */
 };
 #define OPT_BATCH_MODE (option_mask32 & OPT_b)
 
@@ -261,82 +284,118 @@ static int mult_lvl_cmp(void* a, void* b)
 	return inverted ? -cmp_val : cmp_val;
 }
 
-static NOINLINE int read_cpu_jiffy(FILE *fp, jiffy_counts_t *p_jif)
+static void swap_elem(char *a, char *b, size_t size)
 {
-#if !ENABLE_FEATURE_TOP_SMP_CPU
-	static const char fmt[] = "cpu %llu %llu %llu %llu %llu %llu %llu %llu";
-#else
-	static const char fmt[] = "cp%*s %llu %llu %llu %llu %llu %llu %llu %llu";
-#endif
-	int ret;
-
-	if (!fgets(line_buf, LINE_BUF_SIZE, fp) || line_buf[0] != 'c' /* not "cpu" */)
-		return 0;
-	ret = sscanf(line_buf, fmt,
-			&p_jif->usr, &p_jif->nic, &p_jif->sys, &p_jif->idle,
-			&p_jif->iowait, &p_jif->irq, &p_jif->softirq,
-			&p_jif->steal);
-	if (ret >= 4) {
-		p_jif->total = p_jif->usr + p_jif->nic + p_jif->sys + p_jif->idle
-			+ p_jif->iowait + p_jif->irq + p_jif->softirq + p_jif->steal;
-		/* procps 2.x does not count iowait as busy time */
-		p_jif->busy = p_jif->total - p_jif->idle - p_jif->iowait;
+	while (size--) {
+		char t = *a;
+		*a++ = *b;
+		*b++ = t;
+	}
+}
+
+static void heap_sift(char *base, unsigned i, unsigned k, size_t size,
+		int (*cmp)(const void *, const void *))
+{
+	for (;;) {
+		unsigned big = i, l = 2 * i + 1, r = l + 1;
+
+		if (l < k && cmp(base + l * size, base + big * size) > 0)
+			big = l;
+		if (r < k && cmp(base + r * size, base + big * size) > 0)
+			big = r;
+		if (big == i)
+			return;
+		swap_elem(base + i * size, base + big * size, size);
+		i = big;
+	}
+}
+
+/* Sort only the k entries of base[n] that come first: keep the best k seen
+ * so far in a heap rooted at the worst of them, O(n log k) instead of
+ * sorting all n.  Returns the number of sorted entries at the front.
+ */
+static unsigned partial_sort(void *base, unsigned n, unsigned k, size_t size,
+		int (*cmp)(const void *, const void *))
+{
+	char *b = base;
+	unsigned i;
+
+	if (k == 0 || k >= n) {
+		qsort(base, n, size, cmp);
+		return n;
+	}
+	for (i = k / 2; i--; )
+		heap_sift(b, i, k, size, cmp);
+	for (i = k; i < n; i++) {
+		if (cmp(b + i * size, b) >= 0)
+			continue;
+		swap_elem(b + i * size, b, size);
+		heap_sift(b, 0, k, size, cmp);
 	}
+	qsort(base, k, size, cmp);
+	return k;
+}
 
-	return ret;
+static void read_cpu_jiffy(const struct procstat_cpu *c, jiffy_counts_t *p_jif)
+{
+	p_jif->usr = c->user;
+	p_jif->nic = c->nice;
+	p_jif->sys = c->system;
+	p_jif->idle = c->idle;
+	p_jif->iowait = c->iowait;
+	p_jif->irq = c->irq;
+	p_jif->softirq = c->softirq;
+	p_jif->steal = c->steal;
+	p_jif->total = p_jif->usr + p_jif->nic + p_jif->sys + p_jif->idle
+		+ p_jif->iowait + p_jif->irq + p_jif->softirq + p_jif->steal;
+	/* procps 2.x does not count iowait as busy time */
+	p_jif->busy = p_jif->total - p_jif->idle - p_jif->iowait;
 }
 
 static void get_jiffy_counts(void)
 {
-	FILE* fp = xfopen_for_read("stat");
+	/* shared with mpstat and friends, read at most once per tick */
+	if (procstat_get(&TS.stat) < 0)
+		bb_error_msg_and_die("can't read '%s'", "/proc/stat");
 
 	/* We need to parse cumulative counts even if SMP CPU display is on,
 	 * they are used to calculate per process CPU% */
 	prev_jif = cur_jif;
-	if (read_cpu_jiffy(fp, &cur_jif) < 4)
-		bb_error_msg_and_die("can't read '%s'", "/proc/stat");
+	read_cpu_jiffy(&TS.stat.cpu[0], &cur_jif);
 
 #if !ENABLE_FEATURE_TOP_SMP_CPU
-	fclose(fp);
 	return;
 #else
-	if (!smp_cpu_info) {
-		fclose(fp);
+	if (!smp_cpu_info)
 		return;
-	}
 
 	if (!num_cpus) {
-		/* First time here. How many CPUs?
-		 * There will be at least 1 /proc/stat line with cpu%d
-		 */
-		while (1) {
-			cpu_jif = xrealloc_vector(cpu_jif, 1, num_cpus);
-			if (read_cpu_jiffy(fp, &cpu_jif[num_cpus]) <= 4)
-				break;
-			num_cpus++;
-		}
-		if (num_cpus == 0) /* /proc/stat with only "cpu ..." line?! */
+		/* First time here. How many CPUs? */
+		num_cpus = TS.stat.nr_cpu;
+		if (num_cpus == 0) { /* /proc/stat with only "cpu ..." line?! */
 			smp_cpu_info = 0;
-
+			return;
+		}
+		cpu_jif = xmalloc(sizeof(cpu_jif[0]) * num_cpus);
+		/* all zero: the first per cpu display shows usage since boot */
 		cpu_prev_jif = xzalloc(sizeof(cpu_prev_jif[0]) * num_cpus);
-
-		/* Otherwise the first per cpu display shows all 100% idles */
-		usleep(50000);
 	} else { /* Non first time invocation */
 		jiffy_counts_t *tmp;
-		int i;
 
 		/* First switch the sample pointers: no need to copy */
 		tmp = cpu_prev_jif;
 		cpu_prev_jif = cpu_jif;
 		cpu_jif = tmp;
+	}
+	{
+		int i;
 
-		/* Get the new samples */
-		for (i = 0; i < num_cpus; i++)
-			read_cpu_jiffy(fp, &cpu_jif[i]);
+		/* Get the new samples; CPUs plugged in since the first call
+		 * are not shown */
+		for (i = 0; i < num_cpus && i < TS.stat.nr_cpu; i++)
+			read_cpu_jiffy(&TS.stat.cpu[i + 1], &cpu_jif[i]);
 	}
 #endif
-	fclose(fp);
 }
 
 static void do_stats(void)
@@ -345,11 +404,32 @@ static void do_stats(void)
 	pid_t pid;
 	int i, last_i, n;
 	struct save_hist *new_hist;
+	unsigned long long now = 0;
+	unsigned ncpu = 0;
 
 	get_jiffy_counts();
 	total_pcpu = 0;
+	pcpu_lifetime = !prev_hist_count;
+	if (pcpu_lifetime) {
+		/* First scan, or the history was reset: rather than sleeping
+		 * and scanning again, show each process's average since it
+		 * started. Later calls diff against this scan.
+		 */
+		struct timespec ts;
+		unsigned hz = sysconf(_SC_CLK_TCK);
+
+		clock_gettime(CLOCK_BOOTTIME, &ts);
+		now = (unsigned long long)ts.tv_sec * hz
+			+ ts.tv_nsec / (1000000000 / hz);
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	}
 	/* total_vsz = 0; */
-	new_hist = xmalloc(sizeof(new_hist[0]) * ntop);
+	if (TS.hist_alloc[1] < (unsigned)ntop) {
+		TS.hist_alloc[1] = ntop + ntop / 2;
+		free(TS.hist[1]);
+		TS.hist[1] = xmalloc(sizeof(new_hist[0]) * TS.hist_alloc[1]);
+	}
+	new_hist = TS.hist[1];
 	/*
 	 * Make a pass through the data to get stats.
 	 */
@@ -364,6 +444,7 @@ static void do_stats(void)
 		 */
 		pid = cur->pid;
 		new_hist[n].ticks = cur->ticks;
+		new_hist[n].start_time = cur->start_time;
 		new_hist[n].pid = pid;
 
 		/* find matching entry from previous pass */
@@ -373,21 +454,33 @@ static void do_stats(void)
 		last_i = i;
 		if (prev_hist_count) do {
 			if (prev_hist[i].pid == pid) {
-				cur->pcpu = cur->ticks - prev_hist[i].ticks;
-				total_pcpu += cur->pcpu;
+				/* a reused pid is a new process: no delta */
+				if (prev_hist[i].start_time == cur->start_time) {
+					cur->pcpu = cur->ticks - prev_hist[i].ticks;
+					total_pcpu += cur->pcpu;
+				}
 				break;
 			}
 			i = (i+1) % prev_hist_count;
 			/* hist_iterations++; */
 		} while (i != last_i);
+		if (pcpu_lifetime && now > cur->start_time) {
+			/* share of all CPUs, like the delta path */
+			cur->pcpu = (unsigned long long)cur->ticks
+				* (ENABLE_FEATURE_TOP_DECIMALS ? 1000 : 100)
+				/ ((now - cur->start_time) * ncpu);
+		}
 		/* total_vsz += cur->vsz; */
 	}
 
 	/*
-	 * Save cur frame's information.
+	 * Save cur frame's information, keep the old buffer for the next one.
 	 */
-	free(prev_hist);
+	TS.hist[1] = prev_hist;
 	prev_hist = new_hist;
+	i = TS.hist_alloc[1];
+	TS.hist_alloc[1] = TS.hist_alloc[0];
+	TS.hist_alloc[0] = i;
 	prev_hist_count = ntop;
 }
 
@@ -499,59 +592,37 @@ static void display_cpus(int scr_width, char *scrbuf, int *lines_rem_p)
 # define display_cpus(scr_width, scrbuf, lines_rem) ((void)0)
 #endif
 
+/* "Name:    NNNN kB" out of a meminfo buffer, 0 if it is not there */
+static unsigned long meminfo_kb(const char *buf, const char *name)
+{
+	const char *p = strstr(buf, name);
+
+	return p ? strtoul(p + strlen(name), NULL, 10) : 0;
+}
+
 static unsigned long display_header(int scr_width, int *lines_rem_p)
 {
-	FILE *fp;
 	char buf[80];
 	char scrbuf[80];
+	char meminfo_buf[1024]; /* the fields below are all near the top */
 	unsigned long total, used, mfree, shared, buffers, cached;
-
-	/* read memory info */
-	fp = xfopen_for_read("meminfo");
-
+	ssize_t sz;
+
+	/* read memory info; 2.6+ only has the one-field-per-line format */
+	sz = proc_read_close("meminfo", meminfo_buf, sizeof(meminfo_buf) - 1);
+	meminfo_buf[sz > 0 ? sz : 0] = '\0';
+	total = meminfo_kb(meminfo_buf, "MemTotal:");
+	if (!total)
+		bb_error_msg_and_die("can't read '%s'", "/proc/meminfo");
+	mfree = meminfo_kb(meminfo_buf, "MemFree:");
 	/*
-	 * Old kernels (such as 2.4.x) had a nice summary of memory info that
-	 * we could parse, however this is gone entirely in 2.6. Try parsing
-	 * the old way first, and if that fails, parse each field manually.
-	 *
-	 * First, we read in the first line. Old kernels will have bogus
-	 * strings we don't care about, whereas new kernels will start right
-	 * out with MemTotal:
-	 *                              -- PFM.
+	 * MemShared: is no longer present in 2.6. Report this as 0,
+	 * to maintain consistent behavior with normal procps.
 	 */
-	if (fscanf(fp, "MemTotal: %lu %s\n", &total, buf) != 2) {
-		fgets(buf, sizeof(buf), fp);    /* skip first line */
-
-		fscanf(fp, "Mem: %lu %lu %lu %lu %lu %lu",
-			&total, &used, &mfree, &shared, &buffers, &cached);
-		/* convert to kilobytes */
-		used /= 1024;
-		mfree /= 1024;
-		shared /= 1024;
-		buffers /= 1024;
-		cached /= 1024;
-		total /= 1024;
-	} else {
-		/*
-		 * Revert to manual parsing, which incidentally already has the
-		 * sizes in kilobytes. This should be safe for both 2.4 and
-		 * 2.6.
-		 */
-		fscanf(fp, "MemFree: %lu %s\n", &mfree, buf);
-
-		/*
-		 * MemShared: is no longer present in 2.6. Report this as 0,
-		 * to maintain consistent behavior with normal procps.
-		 */
-		if (fscanf(fp, "MemShared: %lu %s\n", &shared, buf) != 2)
-			shared = 0;
-
-		fscanf(fp, "Buffers: %lu %s\n", &buffers, buf);
-		fscanf(fp, "Cached: %lu %s\n", &cached, buf);
-
-		used = total - mfree;
-	}
-	fclose(fp);
+	shared = 0;
+	buffers = meminfo_kb(meminfo_buf, "Buffers:");
+	cached = meminfo_kb(meminfo_buf, "Cached:");
+	used = total - mfree;
 
 	/* output memory info */
 	if (scr_width > (int)sizeof(scrbuf))
@@ -570,7 +641,7 @@ static unsigned long display_header(int scr_width, int *lines_rem_p)
 
 	/* read load average as a string */
 	buf[0] = '\0';
-	open_read_close("loadavg", buf, sizeof(buf) - 1);
+	proc_read_close("loadavg", buf, sizeof(buf) - 1);
 	buf[sizeof(buf) - 1] = '\n';
 	*strchr(buf, '\n') = '\0';
 	snprintf(scrbuf, scr_width, "Load average: %s", buf);
@@ -587,7 +658,7 @@ static NOINLINE void display_process_list(int lines_rem, int scr_width, FILE* fp
 	};
 
 	top_status_t *s;
-	char vsz_str_buf[8];
+	char vsz_str_buf[24]; /* "%6ldm " of a long, with its NUL */
 	unsigned long total_memory = display_header(scr_width, &lines_rem); /* or use total_vsz? */
 	/* xxx_shift and xxx_scale variables allow us to replace
 	 * expensive divides with multiply and shift */
@@ -671,7 +742,8 @@ static NOINLINE void display_process_list(int lines_rem, int scr_width, FILE* fp
 		unsigned col;
 		CALC_STAT(pmem, (s->vsz*pmem_scale + pmem_half) >> pmem_shift);
 #if ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
-		CALC_STAT(pcpu, (s->pcpu*pcpu_scale + pcpu_half) >> pcpu_shift);
+		CALC_STAT(pcpu, pcpu_lifetime ? s->pcpu
+				: (s->pcpu*pcpu_scale + pcpu_half) >> pcpu_shift);
 #endif
 
 		if (s->vsz >= 100000)
@@ -706,25 +778,12 @@ static NOINLINE void display_process_list(int lines_rem, int scr_width, FILE* fp
 #undef CALC_STAT
 #undef FMT
 
-static void clearmems(void)
-{
-	clear_username_cache();
-	free(top);
-	top = NULL;
-}
-
 #if ENABLE_FEATURE_USE_TERMIOS
 
 static void reset_term(void)
 {
 	if (!OPT_BATCH_MODE)
 		tcsetattr_stdin_TCSANOW(&initial_settings);
-	if (ENABLE_FEATURE_CLEAN_UP) {
-		clearmems();
-# if ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
-		free(prev_hist);
-# endif
-	}
 }
 
 static void sig_catcher(int sig)
@@ -778,8 +837,58 @@ static int topmem_sort(char *a, char *b)
 	return inverted ? -n : n;
 }
 
+/* The smaps reads dominate a topmem scan and are independent per process,
+ * so they are spread over up to one thread per CPU; the scan itself only
+ * collects pids.
+ */
+enum {
+	TOPMEM_MAX_WORKERS = 16,
+	TOPMEM_CHUNK = 8,       /* rows a worker takes at a time */
+	TOPMEM_MIN_ROWS = 32,   /* rows that justify one more thread */
+};
+
+static void topmem_worker(struct workpool *wp, int w UNUSED_PARAM)
+{
+	size_t i, end;
+
+	while (workpool_next(wp, &i, &end)) {
+		for (; i < end; i++) {
+			topmem_status_t *t = &topmem[i];
+			struct smaprec r;
+
+			memset(&r, 0, sizeof(r));
+			procps_read_smaps(t->pid, &r, NULL, NULL);
+			t->vsz      = r.mapped_rw + r.mapped_ro;
+			t->vszrw    = r.mapped_rw;
+			t->rss_sh   = r.shared_clean + r.shared_dirty;
+			t->rss      = r.private_clean + r.private_dirty + t->rss_sh;
+			t->dirty    = r.private_dirty + r.shared_dirty;
+			t->dirty_sh = r.shared_dirty;
+			t->stack    = r.stack;
+		}
+	}
+}
+
+static void topmem_fill(void)
+{
+	struct workpool wp;
+	int i, n;
+
+	wp.n = ntop;
+	wp.chunk = TOPMEM_CHUNK;
+	wp.worker = topmem_worker;
+	wp.arg = NULL;
+	workpool_run(&wp, workpool_size(ntop, TOPMEM_MAX_WORKERS, TOPMEM_MIN_ROWS));
+
+	/* kernel threads (and processes gone meanwhile) have no mappings */
+	for (i = n = 0; i < ntop; i++)
+		if (topmem[i].vsz)
+			topmem[n++] = topmem[i];
+	ntop = n;
+}
+
 /* display header info (meminfo / loadavg) */
-static void display_topmem_header(int scr_width, int *lines_rem_p)
+static void display_topmem_header(int scr_width, int *lines_rem_p, FILE *fp)
 {
 	enum {
 		TOTAL = 0, MFREE, BUF, CACHE,
@@ -809,7 +918,7 @@ static void display_topmem_header(int scr_width, int *lines_rem_p)
 		Z[i] = "?";
 
 	/* read memory info */
-	sz = open_read_close("meminfo", meminfo_buf, sizeof(meminfo_buf) - 1);
+	sz = proc_read_close("meminfo", meminfo_buf, sizeof(meminfo_buf) - 1);
 	if (sz >= 0) {
 		char *p = meminfo_buf;
 		meminfo_buf[sz] = '\0';
@@ -829,17 +938,17 @@ static void display_topmem_header(int scr_width, int *lines_rem_p)
 	snprintf(line_buf, LINE_BUF_SIZE,
 		"Mem total:%s anon:%s map:%s free:%s",
 		Z[TOTAL], Z[ANON], Z[MAP], Z[MFREE]);
-	printf(OPT_BATCH_MODE ? "%.*s\n" : "\033[H\033[J%.*s\n", scr_width, line_buf);
+	fprintf(fp, OPT_BATCH_MODE ? "%.*s\n" : "\033[H\033[J%.*s\n", scr_width, line_buf);
 
 	snprintf(line_buf, LINE_BUF_SIZE,
 		" slab:%s buf:%s cache:%s dirty:%s write:%s",
 		Z[SLAB], Z[BUF], Z[CACHE], Z[DIRTY], Z[MWRITE]);
-	printf("%.*s\n", scr_width, line_buf);
+	fprintf(fp, "%.*s\n", scr_width, line_buf);
 
 	snprintf(line_buf, LINE_BUF_SIZE,
 		"Swap total:%s free:%s", // TODO: % used?
 		Z[SWAPTOTAL], Z[SWAPFREE]);
-	printf("%.*s\n", scr_width, line_buf);
+	fprintf(fp, "%.*s\n", scr_width, line_buf);
 
 	(*lines_rem_p) -= 3;
 }
@@ -850,16 +959,16 @@ static void ulltoa6_and_space(unsigned long long ul, char buf[6])
 	smart_ulltoa5(ul, buf, " mgtpezy")[0] = ' ';
 }
 
-static NOINLINE void display_topmem_process_list(int lines_rem, int scr_width)
+static NOINLINE void display_topmem_process_list(int lines_rem, int scr_width, FILE *fp)
 {
 #define HDR_STR "  PID   VSZ VSZRW   RSS (SHR) DIRTY (SHR) STACK"
 #define MIN_WIDTH sizeof(HDR_STR)
 	const topmem_status_t *s = topmem + G_scroll_ofs;
 
-	display_topmem_header(scr_width, &lines_rem);
+	display_topmem_header(scr_width, &lines_rem, fp);
 	strcpy(line_buf, HDR_STR " COMMAND");
 	line_buf[11 + sort_field * 6] = "^_"[inverted];
-	printf(OPT_BATCH_MODE ? "%.*s" : "\e[7m%.*s\e[0m", scr_width, line_buf);
+	fprintf(fp, OPT_BATCH_MODE ? "%.*s" : "\e[7m%.*s\e[0m", scr_width, line_buf);
 	lines_rem--;
 
 	if (lines_rem > ntop - G_scroll_ofs)
@@ -878,17 +987,17 @@ static NOINLINE void display_topmem_process_list(int lines_rem, int scr_width)
 		if (scr_width > (int)MIN_WIDTH) {
 			read_cmdline(&line_buf[8*6], scr_width - MIN_WIDTH, s->pid, s->comm);
 		}
-		printf("\n""%.*s", scr_width, line_buf);
+		fprintf(fp, "\n""%.*s", scr_width, line_buf);
 		s++;
 	}
-	bb_putchar(OPT_BATCH_MODE ? '\n' : '\r');
-	fflush_all();
+	fputc(OPT_BATCH_MODE ? '\n' : '\r', fp);
+	fflush(fp);
 #undef HDR_STR
 #undef MIN_WIDTH
 }
 
 #else
-void display_topmem_process_list(int lines_rem, int scr_width);
+void display_topmem_process_list(int lines_rem, int scr_width, FILE *fp);
 int topmem_sort(char *a, char *b);
 #endif /* TOPMEM */
 
@@ -903,14 +1012,14 @@ enum {
 		| PSSCAN_VSZ
 		| PSSCAN_STIME
 		| PSSCAN_UTIME
+		| PSSCAN_START_TIME
 		| PSSCAN_STATE
 		| PSSCAN_COMM
 		| PSSCAN_CPU
 		| PSSCAN_UIDGID,
 	TOPMEM_MASK = 0
 		| PSSCAN_PID
-		| PSSCAN_SMAPS
-		| PSSCAN_COMM,
+		| PSSCAN_COMM, /* smaps are read by topmem_fill() */
 	EXIT_MASK = (unsigned)-1,
 };
 
@@ -1018,8 +1127,6 @@ static unsigned handle_input(unsigned scan_mask, unsigned interval)
 #  if ENABLE_FEATURE_TOPMEM
 		if (c == 's') {
 			scan_mask = TOPMEM_MASK;
-			free(prev_hist);
-			prev_hist = NULL;
 			prev_hist_count = 0;
 			sort_field = (sort_field + 1) % NUM_SORT_FIELD;
 			continue;
@@ -1039,7 +1146,7 @@ static unsigned handle_input(unsigned scan_mask, unsigned interval)
 				cpu_jif = &cur_jif;
 				cpu_prev_jif = &prev_jif;
 			} else {
-				/* Prepare for xrealloc() */
+				/* get_jiffy_counts() allocates them */
 				cpu_jif = cpu_prev_jif = NULL;
 			}
 			num_cpus = 0;
@@ -1062,7 +1169,7 @@ static unsigned handle_input(unsigned scan_mask, unsigned interval)
 //usage:# define IF_SHOW_THREADS_OR_TOP_SMP(...)
 //usage:#endif
 //usage:#define top_trivial_usage
-//usage:       "[-b] [-nCOUNT] [-dSECONDS]" IF_FEATURE_TOPMEM(" [-m]")
+//usage:       "[-b] [-nCOUNT] [-dSECONDS] [-lN]" IF_FEATURE_TOPMEM(" [-m]")
 //usage:#define top_full_usage "\n\n"
 //usage:       "Provide a view of process activity in real time."
 //usage:   "\n""Read the status of all processes from /proc each SECONDS"
@@ -1105,23 +1212,32 @@ static unsigned handle_input(unsigned scan_mask, unsigned interval)
  * TODO: -i STRING param as a better alternative?
  */
 
-static void cleanup_mem(void)
+/* make room for row n; the top and topmem rows share the buffer */
+static void grow_rows(unsigned n)
 {
-	if (ENABLE_FEATURE_CLEAN_UP) {
-		clearmems();
-# if ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
-		free(prev_hist);
-# endif
-	}
+	enum {
+		ROW_SIZE = sizeof(top_status_t) > sizeof(topmem_status_t)
+			? sizeof(top_status_t) : sizeof(topmem_status_t)
+	};
+
+	if (n < TS.rows_alloc)
+		return;
+	TS.rows_alloc = n < 256 ? 256 : n * 2;
+	TS.rows = xrealloc(TS.rows, TS.rows_alloc * ROW_SIZE);
 }
 
+static const char top_longopts[] ALIGN1 =
+	"top\0" Required_argument "l"
+	;
+
 int top_main(int argc, char **argv, int fd) //MAIN_EXTERNALLY_VISIBLE;
 //int top_main(int argc UNUSED_PARAM, char **argv)
 {
 	int iterations;
 	unsigned col;
 	unsigned interval;
-	char *str_interval, *str_iterations;
+	unsigned limit;
+	char *str_interval, *str_iterations, *str_limit;
 	unsigned scan_mask = TOP_MASK;
 	FILE *fp = fdopen(fd, "w");
 	if(fp == NULL) return EXIT_SUCCESS;
@@ -1132,6 +1248,7 @@ int top_main(int argc, char **argv, int fd) //MAIN_EXTERNALLY_VISIBLE;
 
 	interval = 5; /* default update interval is 5 seconds */
 	iterations = 0; /* infinite */
+	limit = 0; /* all processes */
 #if ENABLE_FEATURE_TOP_SMP_CPU
 	/*num_cpus = 0;*/
 	/*smp_cpu_info = 0;*/  /* to start with show aggregate */
@@ -1140,7 +1257,8 @@ int top_main(int argc, char **argv, int fd) //MAIN_EXTERNALLY_VISIBLE;
 #endif
 	/* all args are options; -n NUM */
 	opt_complementary = "-"; /* options can be specified w/o dash */
-	col = getopt32(argv, "d:n:b"IF_FEATURE_TOPMEM("m"), &str_interval, &str_iterations);
+	applet_long_options = top_longopts;
+	col = getopt32(argv, "d:n:bl:"IF_FEATURE_TOPMEM("m"), &str_interval, &str_iterations, &str_limit);
 #if ENABLE_FEATURE_TOPMEM
 	if (col & OPT_m) /* -m (busybox specific) */
 		scan_mask = TOPMEM_MASK;
@@ -1159,12 +1277,12 @@ int top_main(int argc, char **argv, int fd) //MAIN_EXTERNALLY_VISIBLE;
 		//iterations = xatou(str_iterations);
 		iterations = atoi(str_iterations);
 	}
-
-	/* change to /proc */
-	char oldpath[128];
-    getcwd(oldpath, 128);
-	//printf("oldpath:%s\n",oldpath);
-	xchdir("/proc");
+	if (col & OPT_l) { /* -l N, --top N: only the first N rows are wanted */
+		if (str_limit[0] == '-')
+			str_limit++;
+		//limit = xatou(str_limit);
+		limit = atoi(str_limit);
+	}
 
 #if ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
 	sort_function[0] = pcpu_sort;
@@ -1193,7 +1311,7 @@ int top_main(int argc, char **argv, int fd) //MAIN_EXTERNALLY_VISIBLE;
 #endif
 
 	while (scan_mask != EXIT_MASK) {
-		procps_status_t *p = NULL;
+		procps_status_t *p;
 
 		if (OPT_BATCH_MODE) {
 			G.lines = INT_MAX;
@@ -1214,6 +1332,11 @@ int top_main(int argc, char **argv, int fd) //MAIN_EXTERNALLY_VISIBLE;
 		}
 		//G.lines = 50;
 		/* read process IDs & status for all the processes */
+		if (!TS.scan) {
+			TS.scan = alloc_procps_scan();
+			TS.scan->reuse = 1;
+		}
+		p = TS.scan;
 		ntop = 0;
 		while ((p = procps_scan(p, scan_mask)) != NULL) {
 			int n;
@@ -1222,12 +1345,13 @@ int top_main(int argc, char **argv, int fd) //MAIN_EXTERNALLY_VISIBLE;
 #endif
 			{
 				n = ntop;
-				top = xrealloc_vector(top, 6, ntop++);
+				grow_rows(ntop++);
 				top[n].pid = p->pid;
 				top[n].ppid = p->ppid;
 				top[n].vsz = p->vsz;
 #if ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
 				top[n].ticks = p->stime + p->utime;
+				top[n].start_time = p->start_time;
 #endif
 				top[n].uid = p->uid;
 				strcpy(top[n].state, p->state);
@@ -1238,23 +1362,18 @@ int top_main(int argc, char **argv, int fd) //MAIN_EXTERNALLY_VISIBLE;
 			}
 #if ENABLE_FEATURE_TOPMEM
 			else { /* TOPMEM */
-				if (!(p->smaps.mapped_ro | p->smaps.mapped_rw))
-					continue; /* kernel threads are ignored */
 				n = ntop;
 				/* No bug here - top and topmem are the same */
-				top = xrealloc_vector(topmem, 6, ntop++);
+				grow_rows(ntop++);
 				strcpy(topmem[n].comm, p->comm);
 				topmem[n].pid      = p->pid;
-				topmem[n].vsz      = p->smaps.mapped_rw + p->smaps.mapped_ro;
-				topmem[n].vszrw    = p->smaps.mapped_rw;
-				topmem[n].rss_sh   = p->smaps.shared_clean + p->smaps.shared_dirty;
-				topmem[n].rss      = p->smaps.private_clean + p->smaps.private_dirty + topmem[n].rss_sh;
-				topmem[n].dirty    = p->smaps.private_dirty + p->smaps.shared_dirty;
-				topmem[n].dirty_sh = p->smaps.shared_dirty;
-				topmem[n].stack    = p->smaps.stack;
 			}
 #endif
 		} /* end of "while we read /proc" */
+#if ENABLE_FEATURE_TOPMEM
+		if (scan_mask == TOPMEM_MASK)
+			topmem_fill();
+#endif
 		if (ntop == 0) {
 			bb_error_msg("no process info in /proc");
 			break;
@@ -1262,31 +1381,23 @@ int top_main(int argc, char **argv, int fd) //MAIN_EXTERNALLY_VISIBLE;
 
 		if (scan_mask != TOPMEM_MASK) {
 #if ENABLE_FEATURE_TOP_CPU_USAGE_PERCENTAGE
-			if (!prev_hist_count) {
-				do_stats();
-				usleep(100000);
-				clearmems();
-				continue;
-			}
 			do_stats();
-			/* TODO: we don't need to sort all 10000 processes, we need to find top 24! */
-			qsort(top, ntop, sizeof(top_status_t), (void*)mult_lvl_cmp);
+			ntop = partial_sort(top, ntop, limit, sizeof(top_status_t), (void*)mult_lvl_cmp);
 #else
-			qsort(top, ntop, sizeof(top_status_t), (void*)(sort_function[0]));
+			ntop = partial_sort(top, ntop, limit, sizeof(top_status_t), (void*)(sort_function[0]));
 #endif
 		}
 #if ENABLE_FEATURE_TOPMEM
 		else { /* TOPMEM */
-			qsort(topmem, ntop, sizeof(topmem_status_t), (void*)topmem_sort);
+			ntop = partial_sort(topmem, ntop, limit, sizeof(topmem_status_t), (void*)topmem_sort);
 		}
 #endif
 		if (scan_mask != TOPMEM_MASK)
 			display_process_list(G.lines, col, fp);
 #if ENABLE_FEATURE_TOPMEM
 		else
-			display_topmem_process_list(G.lines, col);
+			display_topmem_process_list(G.lines, col, fp);
 #endif
-		clearmems();
 		//if (iterations >= 0 && !--iterations)
 			break;
 #if !ENABLE_FEATURE_USE_TERMIOS
@@ -1300,8 +1411,6 @@ int top_main(int argc, char **argv, int fd) //MAIN_EXTERNALLY_VISIBLE;
 #if ENABLE_FEATURE_USE_TERMIOS
 	reset_term();
 #endif
-	cleanup_mem();
 	fclose(fp);
-	xchdir(oldpath);
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,112 @@
+/*
+ * workpool.c: fetch-and-add worker pool shared by the module libraries
+ *
+ * Licensed under GPLv2 or later.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "workpool.h"
+
+struct workpool_thread {
+	struct workpool *wp;
+	int w;
+};
+
+/*
+ ***************************************************************************
+ * Number of workers worth starting for a job.
+ *
+ * IN:
+ * @n		Items in the job.
+ * @max		Upper bound on the workers.
+ * @min_items	Items that justify one more worker.
+ *
+ * RETURNS:
+ * Number of workers, at least 1.
+ ***************************************************************************
+ */
+int workpool_size(size_t n, int max, size_t min_items)
+{
+	long nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (max > WORKPOOL_MAX_WORKERS)
+		max = WORKPOOL_MAX_WORKERS;
+	if (nworkers > max)
+		nworkers = max;
+	if (min_items && nworkers > 1 + (long) (n / min_items))
+		nworkers = 1 + n / min_items;
+	if (nworkers > (long) n)
+		nworkers = n;
+	return nworkers < 1 ? 1 : nworkers;
+}
+
+/*
+ ***************************************************************************
+ * Claim the next chunk of a job.
+ *
+ * IN:
+ * @wp		Job being run.
+ *
+ * OUT:
+ * @begin	First item of the chunk.
+ * @end		Item past the end of the chunk.
+ *
+ * RETURNS:
+ * 1 if a chunk was claimed, 0 if every item is taken.
+ ***************************************************************************
+ */
+int workpool_next(struct workpool *wp, size_t *begin, size_t *end)
+{
+	size_t i = __sync_fetch_and_add(&wp->next, wp->chunk);
+
+	if (i >= wp->n)
+		return 0;
+	*begin = i;
+	*end = (wp->n - i < wp->chunk) ? wp->n : i + wp->chunk;
+	return 1;
+}
+
+static void *workpool_thread(void *arg)
+{
+	struct workpool_thread *t = arg;
+
+	t->wp->worker(t->wp, t->w);
+	return NULL;
+}
+
+/*
+ ***************************************************************************
+ * Run a job on @nworkers workers, the calling thread being worker 0, and
+ * return once all items are done.  A worker whose thread fails to start
+ * does not run: the others claim its share.
+ *
+ * IN:
+ * @wp		Job to run; next is reset.
+ * @nworkers	Number of workers, as from workpool_size().
+ ***************************************************************************
+ */
+void workpool_run(struct workpool *wp, int nworkers)
+{
+	pthread_t threads[WORKPOOL_MAX_WORKERS];
+	struct workpool_thread t[WORKPOOL_MAX_WORKERS];
+	int started[WORKPOOL_MAX_WORKERS];
+	int w;
+
+	if (nworkers > WORKPOOL_MAX_WORKERS)
+		nworkers = WORKPOOL_MAX_WORKERS;
+	if (!wp->chunk)
+		wp->chunk = 1;
+	wp->next = 0;
+
+	for (w = 1; w < nworkers; w++) {
+		t[w].wp = wp;
+		t[w].w = w;
+		started[w] = !pthread_create(&threads[w], NULL, workpool_thread, &t[w]);
+	}
+	wp->worker(wp, 0);
+	for (w = 1; w < nworkers; w++)
+		if (started[w])
+			pthread_join(threads[w], NULL);
+}
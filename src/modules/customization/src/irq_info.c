@@ -14,62 +14,38 @@
 #include <stdlib.h>
 #include <getopt.h>
 
-#define BUFFSIZE (64*1024)
+#include "procstat.h"
+
 static unsigned long long sleep_time = 1;
 
 int irq_info_main(int argc, char *argv[], int out_fd){
 
 /*******************************
-  1 read /proc/stat
-  2 get irqs
-    b = strstr(buff, "intr ");
-    if(b) sscanf(b,  "intr %llu", &llbuf);
-     *intr = llbuf;
-  3 get softirqs
-    b = strstr(buff, "softirq ");
-    if(b) sscanf(b,  "softirq %llu", &llbuf);
-    *sofrirq = llbuf;
-  4 sleep 1 sec
-  5 repeat
-  6 irq2 - irq1, softirq2 - softirq2
-  7 return
+  1 take a /proc/stat snapshot
+  2 get irqs and softirqs
+  3 sleep 1 sec
+  4 repeat
+  5 irq2 - irq1, softirq2 - softirq1
+  6 return
 **********************************/
         unsigned long long irq[2]= {0}, softirq[2]= {0};
-        static int fd;
-        const char *b = NULL;
-        unsigned long long llbuf = 0;
-        char buff[BUFFSIZE-1] = {0};
+        struct procstat ps = {0};
 	FILE *out_fp = fdopen(out_fd, "w");
 
-	fd = open("/proc/stat", O_RDONLY, 0);
-	read(fd, buff, BUFFSIZE-1);
-        b = strstr(buff, "intr");
-        if (b)
-                sscanf(b, "intr %Lu", &llbuf);
-        irq[0] = llbuf;
-
-        b = strstr(buff, "softirq");
-        if (b)
-                sscanf(b, "softirq %Lu", &llbuf);
-        softirq[0] = llbuf;
-        close(fd);
+        if (procstat_get(&ps) == 0) {
+                irq[0] = ps.intr;
+                softirq[0] = ps.softirq;
+        }
 
         sleep(sleep_time);
 
-        fd = open("/proc/stat", O_RDONLY, 0);
-	read(fd, buff, BUFFSIZE-1);
-        b = strstr(buff, "intr");
-        if (b)
-        	sscanf(b, "intr %Lu", &llbuf);
-        irq[1] = llbuf;
-
-        b = strstr(buff, "softirq");
-        if (b)
-        	sscanf(b, "softirq %Lu", &llbuf);
-        softirq[1] = llbuf;
-        close(fd);
+        if (procstat_get(&ps) == 0) {
+                irq[1] = ps.intr;
+                softirq[1] = ps.softirq;
+        }
+        procstat_free(&ps);
 
-        fprintf(out_fp,"irq:%d/s softirq:%d/s \n", irq[1]-irq[0], softirq[1]-softirq[0]);
+        fprintf(out_fp,"irq:%llu/s softirq:%llu/s \n", irq[1]-irq[0], softirq[1]-softirq[0]);
 	fclose(out_fp);
 	return 0;
 }
@@ -52,26 +52,58 @@ struct xxxid_stats
     int io_prio;
 
     int euid;
+    uint64_t start_time;  // taskstats ac_btime, seconds since 1970; 0 if unknown
     char *cmdline;
+};
+
+/*
+ * One sample: the stats of all tasks in a contiguous array, indexed by an
+ * open-addressed tid hash so that two samples can be diffed in linear time.
+ */
+struct xxxid_stats_arr
+{
+    struct xxxid_stats *arr;
+    int length;
 
-    void *__next;
+    int *hash;       // arr index, or -1 for an empty slot
+    int hash_size;   // power of two, at least twice length
 };
 
-void nl_init(void);
+int nl_init(void);
 void nl_term(void);
 
 int nl_xxxid_info(pid_t xxxid, int isp, struct xxxid_stats *stats);
 void dump_xxxid_stats(struct xxxid_stats *stats);
 
+/* proc_io.c */
+void proc_xxxid_info_batch(pid_t *tids, pid_t *tgids, int n,
+                           struct xxxid_stats *out, char *ok);
+
 typedef int (*filter_callback)(struct xxxid_stats *);
 
-struct xxxid_stats* fetch_data(int processes, filter_callback);
-void free_stats_chain(struct xxxid_stats *chain);
+struct xxxid_stats_arr *fetch_data(int processes, filter_callback);
+struct xxxid_stats *arr_find(struct xxxid_stats_arr *a, pid_t tid);
+void free_stats_arr(struct xxxid_stats_arr *a);
+
+/* I/O of the tasks that exited between two samples, summed per command */
+#define EXITED_MAX 64
+
+struct exited_io
+{
+    char comm[32];   // TS_COMM_LEN
+    int tasks;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+};
+
+void exits_collect(struct xxxid_stats_arr *cur, struct xxxid_stats_arr *prev,
+                   filter_callback filter);
+struct exited_io *exits_table(int *len, int *tasks);
 
-typedef void (*view_callback)(struct xxxid_stats *current, struct xxxid_stats *prev, int iter, int fd);
+typedef void (*view_callback)(struct xxxid_stats_arr *current, struct xxxid_stats_arr *prev, int iter, int fd);
 
-void view_batch(struct xxxid_stats *, struct xxxid_stats *, int iter, int fd);
-void view_curses(struct xxxid_stats *, struct xxxid_stats *, int iter);
+void view_batch(struct xxxid_stats_arr *, struct xxxid_stats_arr *, int iter, int fd);
+void view_curses(struct xxxid_stats_arr *, struct xxxid_stats_arr *, int iter);
 void view_curses_finish();
 
 typedef int (*how_to_sleep)(unsigned int seconds);
@@ -90,19 +122,28 @@ struct pidgen
     void *__proc;
     void *__task;
     int __flags;
+    int __tgid;      // process of the last pid returned
 };
 
 //const char *xprintf(const char *format, ...);
 const char *read_cmdline2(int pid);
+const char *cached_cmdline(pid_t tid, uint64_t start_time);
+void cmdline_cache_evict(pid_t tid);
 
 struct pidgen *openpidgen(int flags);
 void closepidgen(struct pidgen *pg);
 int pidgen_next(struct pidgen *pg);
+#define pidgen_tgid(pg) ((pg)->__tgid)
 
 /* ioprio.h */
 
 int get_ioprio(pid_t pid);
 const char *str_ioprio(int io_prio);
+const char *str_ioprio_ext(int io_prio, pid_t pid);
+int get_ioprio_ext(pid_t pid);
+
+/* busybox-lite passwd fallback, used when libc has no entry */
+struct passwd *bb_internal_getpwuid(uid_t uid);
 
 #endif // __IOTOP_H__
 
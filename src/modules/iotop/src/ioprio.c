@@ -73,19 +73,13 @@ const char *str_ioprio(int io_prio)
 
         
 
-const char *str_ioprio_ext(int io_prio, pid_t pid)
+/* the priority the scheduler derives for a task with no I/O class set */
+static int effective_ioprio(int io_prio, pid_t pid)
 {
 #define PRIO_PROCESS 0
 #define SCHED_IDLE   5
-    const static char corrupted[] = "xx/x";
-    static char buf[IOPRIO_STR_MAXSIZ];
     int io_class = io_prio >> IOPRIO_CLASS_SHIFT;
 
-    io_prio &= 0xff;
-
-    if (io_class >= IOPRIO_CLASS_MAX)
-        return corrupted;
-
     if(io_class == 0){
 	int scheduler = sched_getscheduler(pid);
 	int nice = getpriority(PRIO_PROCESS, pid);
@@ -97,8 +91,30 @@ const char *str_ioprio_ext(int io_prio, pid_t pid)
 		io_class = IOPRIO_CLASS_IDLE;
 	else
 		io_class = IOPRIO_CLASS_BE;
+	io_prio |= io_class << IOPRIO_CLASS_SHIFT;
     }
 
+    return io_prio;
+}
+
+int get_ioprio_ext(pid_t pid)
+{
+    return effective_ioprio(get_ioprio(pid), pid);
+}
+
+const char *str_ioprio_ext(int io_prio, pid_t pid)
+{
+    const static char corrupted[] = "xx/x";
+    static char buf[IOPRIO_STR_MAXSIZ];
+    int io_class;
+
+    io_prio = effective_ioprio(io_prio, pid);
+    io_class = io_prio >> IOPRIO_CLASS_SHIFT;
+    io_prio &= 0xff;
+
+    if (io_class >= IOPRIO_CLASS_MAX)
+        return corrupted;
+
     snprintf(
         buf,
         IOPRIO_STR_MAXSIZ,
@@ -27,16 +27,11 @@ init_params(void)
 
 static char str_opt[] = "boPaktq";
 
-void
+/* taskstats queries need CAP_NET_ADMIN */
+int
 check_priv(void)
 {
-    if (geteuid() == 0)
-        return;
-
-    errno = EACCES;
-    perror(progname);
-
-    exit(EXIT_FAILURE);
+    return geteuid() == 0;
 }
 
 void
@@ -181,14 +176,17 @@ iotop_main(int argc, char *argv[], int fd)
     progname = argv[0];
 
     parse_args(argc, argv);
-    check_priv();
-
 
-    nl_init();
+    /*
+     * Without root or CONFIG_TASKSTATS, fall back to /proc/PID/io: same
+     * byte counters, no delay accounting, and only the tasks we may read.
+     */
+    if (check_priv())
+        nl_init();
 
 
-    struct xxxid_stats *ps = NULL;
-    struct xxxid_stats *cs = NULL;
+    struct xxxid_stats_arr *ps = NULL;
+    struct xxxid_stats_arr *cs = NULL;
 
     //if (config.f.timestamp || config.f.quite)
         config.f.batch_mode = 1;
@@ -206,10 +204,11 @@ iotop_main(int argc, char *argv[], int fd)
     do
     {
         cs = fetch_data(config.f.processes, filter1);
+        exits_collect(cs, ps, filter1);
         view(cs, ps, params.iter,fd);
 
         if (ps)
-            free_stats_chain(ps);
+            free_stats_arr(ps);
 
         ps = cs;
         if ((params.iter > -1) && ((--params.iter) == 0))
@@ -217,7 +216,7 @@ iotop_main(int argc, char *argv[], int fd)
     }
     while (!do_sleep(params.delay));
 
-    free_stats_chain(cs);
+    free_stats_arr(cs);
     sig_handler(SIGINT);
 
 
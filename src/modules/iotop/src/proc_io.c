@@ -0,0 +1,93 @@
+#include "iotop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * /proc/PID/io backend, used when taskstats is not available.  It gives the
+ * same read_bytes/write_bytes counters; the delay accounting fields stay 0.
+ * /proc/PID/io sums the whole thread group, so threads (including the main
+ * one) are read from /proc/TGID/task/TID/io; a tgid of 0 means that tid is
+ * a process and its group totals are wanted.
+ */
+
+#define IO_BUF_SIZE 512
+
+/* parse the decimal after "key:" in buf, 0 if the key is missing */
+static uint64_t io_field(const char *buf, const char *key, size_t key_len)
+{
+    const char *p = buf;
+    uint64_t v = 0;
+
+    while (*p)
+    {
+        if (!strncmp(p, key, key_len) && p[key_len] == ':')
+        {
+            p += key_len + 1;
+            while (*p == ' ' || *p == '\t')
+                p++;
+            while (*p >= '0' && *p <= '9')
+                v = v * 10 + (*p++ - '0');
+            return v;
+        }
+
+        p = strchr(p, '\n');
+        if (!p)
+            break;
+        p++;
+    }
+
+    return 0;
+}
+
+#define IO_FIELD(buf, key) io_field(buf, key, sizeof(key) - 1)
+
+static int proc_xxxid_info(pid_t tid, pid_t tgid, struct xxxid_stats *stats,
+                           char *buf)
+{
+    char path[48];
+    struct stat st;
+    ssize_t n;
+    int fd;
+
+    if (!tgid)
+        snprintf(path, sizeof(path), "/proc/%d/io", tid);
+    else
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/io", tgid, tid);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    n = pread(fd, buf, IO_BUF_SIZE - 1, 0);
+
+    /* the proc inode is owned by the task's euid */
+    if (n <= 0 || fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    buf[n] = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->tid = tid;
+    stats->euid = st.st_uid;
+    stats->read_bytes = IO_FIELD(buf, "read_bytes");
+    stats->write_bytes = IO_FIELD(buf, "write_bytes");
+
+    return 0;
+}
+
+void proc_xxxid_info_batch(pid_t *tids, pid_t *tgids, int n,
+                           struct xxxid_stats *out, char *ok)
+{
+    static char buf[IO_BUF_SIZE];
+    int i;
+
+    for (i = 0; i < n; i++)
+        ok[i] = !proc_xxxid_info(tids[i], tgids[i], &out[i], buf);
+}
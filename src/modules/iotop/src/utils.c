@@ -65,6 +65,59 @@ const char *read_cmdline2(int pid)
     return rv;
 }
 
+/*
+ * Direct-mapped cmdline cache in front of read_cmdline2(), keyed by tid and
+ * the start time taskstats reports, so that a reused pid does not inherit a
+ * stale command line.  The exit listener also evicts the tids it sees exit,
+ * which covers a pid reused within the same second.  Without taskstats the
+ * start time is unknown and the cache is bypassed.
+ */
+#define CMDLINE_CACHE_SIZE 1024
+
+static struct
+{
+    pid_t tid;
+    uint64_t start_time;
+    char *cmdline;
+} cmdline_cache[CMDLINE_CACHE_SIZE];
+
+#define CMDLINE_SLOT(tid) (((unsigned int) (tid) * 2654435761u) % CMDLINE_CACHE_SIZE)
+
+const char *cached_cmdline(pid_t tid, uint64_t start_time)
+{
+    unsigned int slot = CMDLINE_SLOT(tid);
+    const char *cmdline;
+
+    if (!start_time)
+        return read_cmdline2(tid);
+
+    if (cmdline_cache[slot].cmdline && cmdline_cache[slot].tid == tid
+            && cmdline_cache[slot].start_time == start_time)
+        return cmdline_cache[slot].cmdline;
+
+    cmdline = read_cmdline2(tid);
+    if (!cmdline)
+        return NULL;
+
+    free(cmdline_cache[slot].cmdline);
+    cmdline_cache[slot].cmdline = strdup(cmdline);
+    cmdline_cache[slot].tid = tid;
+    cmdline_cache[slot].start_time = start_time;
+
+    return cmdline_cache[slot].cmdline ? cmdline_cache[slot].cmdline : cmdline;
+}
+
+void cmdline_cache_evict(pid_t tid)
+{
+    unsigned int slot = CMDLINE_SLOT(tid);
+
+    if (cmdline_cache[slot].cmdline && cmdline_cache[slot].tid == tid)
+    {
+        free(cmdline_cache[slot].cmdline);
+        cmdline_cache[slot].cmdline = NULL;
+    }
+}
+
 static int __next_pid(DIR *dir)
 {
     while (1)
@@ -97,6 +150,7 @@ struct pidgen *openpidgen(int flags)
     {
         pg->__task = NULL;
         pg->__flags = flags;
+        pg->__tgid = 0;
         return pg;
     }
 
@@ -135,6 +189,8 @@ int pidgen_next(struct pidgen *pg)
 
     pid = __next_pid((DIR *) pg->__proc);
 
+    pg->__tgid = pid;
+
     if (pid && (pg->__flags & PIDGEN_FLAGS_TASK))
     {
         pg->__task = (DIR *) opendir(xprintf("/proc/%d/task", pid));
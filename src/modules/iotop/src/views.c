@@ -11,59 +11,42 @@
 
 #define HEADER_FORMAT "Total DISK READ: %7.2f %s | Total DISK WRITE: %7.2f %s"
 
-struct xxxid_stats *findpid(struct xxxid_stats *chain, int tid)
+struct xxxid_stats *create_diff(struct xxxid_stats_arr *cs, struct xxxid_stats_arr *ps, int *len)
 {
-    struct xxxid_stats *s;
-
-    for (s = chain; s; s = s->__next)
-        if (s->tid == tid)
-            return s;
+    struct xxxid_stats *diff;
+    int n;
+    uint64_t xxx = ~0;
 
-    return NULL;
-}
+    // No have previous data to calculate diff
+    if (!cs || !cs->length)
+        return NULL;
 
-int chainlen(struct xxxid_stats *chain)
-{
-    int i = 0;
+    diff = malloc(sizeof(struct xxxid_stats) * cs->length);
+    if (!diff)
+        return NULL;
 
-    while (chain)
+    for (n = 0; n < cs->length; n++)
     {
-        i++;
-        chain = chain->__next;
-    }
+        struct xxxid_stats *c = &cs->arr[n];
+        struct xxxid_stats *p = arr_find(ps, c->tid);
 
-    return i;
-}
-
-struct xxxid_stats *create_diff(struct xxxid_stats *cs, struct xxxid_stats *ps, int *len)
-{
-    int diff_size = sizeof(struct xxxid_stats) * chainlen(cs);
-    struct xxxid_stats *diff = malloc(diff_size);
-    struct xxxid_stats *c;
-    int n = 0;
-    uint64_t xxx = ~0;
-
-    memset(diff, 0, diff_size);
-
-    for (c = cs; c; c = c->__next, n++)
-    {
-        struct xxxid_stats *p = findpid(ps, c->tid);
+        memcpy(&diff[n], c, sizeof(struct xxxid_stats));
+        // a diff row owns the cmdline fill_sort_keys() may look up
+        diff[n].cmdline = NULL;
 
         if (!p)
         {
             // new process or task
-            memcpy(&diff[n], c, sizeof(struct xxxid_stats));
             diff[n].read_bytes \
             = diff[n].write_bytes \
               = diff[n].swapin_delay_total \
                 = diff[n].blkio_delay_total \
                   = 0;
-            diff[n].__next = &diff[n + 1];
+            diff[n].read_val = diff[n].write_val = 0;
+            diff[n].blkio_val = diff[n].swapin_val = 0;
             continue;
         }
 
-        memcpy(&diff[n], c, sizeof(struct xxxid_stats));
-
         // round robin value
 
 #define RRV(to, from) {\
@@ -94,32 +77,31 @@ struct xxxid_stats *create_diff(struct xxxid_stats *cs, struct xxxid_stats *ps,
 
         diff[n].write_val = (double) diff[n].write_bytes
                             / (config.f.accumulated ? 1 : params.delay);
-
-        diff[n].__next = &diff[n + 1];
-    }
-
-    // No have previous data to calculate diff
-    if (!n)
-    {
-        free(diff);
-        return NULL;
     }
 
-    diff[n - 1].__next = NULL;
     *len = n;
 
     return diff;
 }
 
-void calc_total(struct xxxid_stats *diff, double *read, double *write)
+void calc_total(struct xxxid_stats *diff, int len, double *read, double *write)
 {
-    struct xxxid_stats *s;
+    int i;
     *read = *write = 0;
 
-    for (s = diff; s; s = s->__next)
+    for (i = 0; i < len; i++)
+    {
+        *read += diff[i].read_bytes;
+        *write += diff[i].write_bytes;
+    }
+
+    int exited_len, exited_tasks;
+    struct exited_io *e = exits_table(&exited_len, &exited_tasks);
+
+    for (i = 0; i < exited_len; i++)
     {
-        *read += s->read_bytes;
-        *write += s->write_bytes;
+        *read += e[i].read_bytes;
+        *write += e[i].write_bytes;
     }
 
     if (!config.f.accumulated)
@@ -166,78 +148,144 @@ enum
 static int sort_by = SORT_BY_IO;
 static int sort_order = SORT_DESC;
 
-void sort_diff(struct xxxid_stats *d)
+/* > 0 when a belongs above b in the listing */
+static int cmp_stats(struct xxxid_stats *a, struct xxxid_stats *b)
+{
+    int r = 0;
+
+#define CMP_FIELDS(field_name) ((a->field_name > b->field_name) - (a->field_name < b->field_name))
+
+    switch (sort_by)
+    {
+    case SORT_BY_PRIO:
+        r = CMP_FIELDS(io_prio);
+        break;
+    case SORT_BY_COMMAND:
+        r = strcmp(a->cmdline ? a->cmdline : "", b->cmdline ? b->cmdline : "");
+        break;
+    case SORT_BY_PID:
+        r = CMP_FIELDS(tid);
+        break;
+    case SORT_BY_USER:
+        r = CMP_FIELDS(euid);
+        break;
+    case SORT_BY_READ:
+        r = CMP_FIELDS(read_val);
+        break;
+    case SORT_BY_WRITE:
+        r = CMP_FIELDS(write_val);
+        break;
+    case SORT_BY_SWAPIN:
+        r = CMP_FIELDS(swapin_val);
+        break;
+    case SORT_BY_IO:
+        r = CMP_FIELDS(blkio_val);
+        /* /proc/PID/io has no delay accounting: fall back to bandwidth */
+        if (!r)
+            r = (a->read_val + a->write_val > b->read_val + b->write_val)
+                - (a->read_val + a->write_val < b->read_val + b->write_val);
+        break;
+    }
+
+#undef CMP_FIELDS
+
+    return sort_order == SORT_ASC ? -r : r;
+}
+
+/*
+ * fetch_data() leaves io_prio and cmdline unset, so look them up for all
+ * the candidate rows when the listing is sorted on one of them
+ */
+static void fill_sort_keys(struct xxxid_stats *d, int len)
 {
-    int len = chainlen(d);
     int i;
 
     for (i = 0; i < len; i++)
     {
-        int k;
-
-        for (k = i; k < len; k++)
+        if (sort_by == SORT_BY_PRIO)
+            d[i].io_prio = get_ioprio_ext(d[i].tid);
+        else if (sort_by == SORT_BY_COMMAND)
         {
-            int found = 0;
+            const char *cmdline = cached_cmdline(d[i].tid, d[i].start_time);
 
-#define CMP_FIELDS(field_name) (d[k].field_name > d[i].field_name)
+            d[i].cmdline = cmdline ? strdup(cmdline) : NULL;
+        }
+    }
+}
 
-            switch (sort_by)
-            {
-            case SORT_BY_PRIO:
-                found = d[k].io_prio > d[i].io_prio;
-                break;
-            case SORT_BY_COMMAND:
-                found = (strcmp(d[k].cmdline, d[i].cmdline) > 0);
-                break;
-            case SORT_BY_PID:
-                found = CMP_FIELDS(tid);
-                break;
-            case SORT_BY_USER:
-                found = CMP_FIELDS(euid);
-                break;
-            case SORT_BY_READ:
-                found = CMP_FIELDS(read_val);
-                break;
-            case SORT_BY_WRITE:
-                found = CMP_FIELDS(write_val);
-                break;
-            case SORT_BY_SWAPIN:
-                found = CMP_FIELDS(swapin_val);
-                break;
-            case SORT_BY_IO:
-                found = CMP_FIELDS(blkio_val);
-                break;
-            }
+static void free_diff(struct xxxid_stats *d, int len)
+{
+    int i;
 
-#undef CMP_FIELDS
+    for (i = 0; i < len; i++)
+        free(d[i].cmdline);
+    free(d);
+}
 
-            if (found)
-            {
-                static struct xxxid_stats tmp;
+static void swap_stats(struct xxxid_stats *a, struct xxxid_stats *b)
+{
+    struct xxxid_stats tmp;
 
-                memcpy(&tmp, &d[i], sizeof(struct xxxid_stats));
-                memcpy(&d[i], &d[k], sizeof(struct xxxid_stats));
-                memcpy(&d[k], &tmp, sizeof(struct xxxid_stats));
-            }
-        }
+    memcpy(&tmp, a, sizeof(struct xxxid_stats));
+    memcpy(a, b, sizeof(struct xxxid_stats));
+    memcpy(b, &tmp, sizeof(struct xxxid_stats));
+}
+
+/* restore the heap property below i; d[0] is the row that sorts lowest */
+static void sift_down(struct xxxid_stats *d, int len, int i)
+{
+    for (;;)
+    {
+        int l = 2 * i + 1, m = i;
+
+        if (l < len && cmp_stats(&d[l], &d[m]) < 0)
+            m = l;
+        if (l + 1 < len && cmp_stats(&d[l + 1], &d[m]) < 0)
+            m = l + 1;
+        if (m == i)
+            return;
+        swap_stats(&d[i], &d[m]);
+        i = m;
     }
+}
 
-    if (sort_order == SORT_ASC)
+/*
+ * Move the top rows to the front of d in display order, leaving the rest
+ * unsorted.  Returns how many rows were placed, min(top, len).
+ */
+int sort_diff(struct xxxid_stats *d, int len, int top)
+{
+    int i;
+
+    if (top > len)
+        top = len;
+    if (top <= 0)
+        return 0;
+
+    /* keep the best "top" rows in a heap rooted at the weakest of them */
+    for (i = top / 2 - 1; i >= 0; i--)
+        sift_down(d, top, i);
+
+    for (i = top; i < len; i++)
     {
-        struct xxxid_stats *rev = malloc(sizeof(struct xxxid_stats) * len);
-        for (i = 0; i < len; i++)
-            memcpy(&rev[i], &d[len - i - 1], sizeof(struct xxxid_stats));
-        memcpy(d, rev, sizeof(struct xxxid_stats) * len);
-        free(rev);
+        if (cmp_stats(&d[i], &d[0]) > 0)
+        {
+            swap_stats(&d[i], &d[0]);
+            sift_down(d, top, 0);
+        }
     }
 
-    for (i = 0; i < len; i++)
-        d[i].__next = &d[i + 1];
+    /* heap sort the survivors, best first */
+    for (i = top - 1; i > 0; i--)
+    {
+        swap_stats(&d[0], &d[i]);
+        sift_down(d, i, 0);
+    }
 
-    d[len - 1].__next = NULL;
+    return top;
 }
 
-void view_curses(struct xxxid_stats *cs, struct xxxid_stats *ps,int iter)
+void view_curses(struct xxxid_stats_arr *cs, struct xxxid_stats_arr *ps,int iter)
 {
 #if 0
     if (!stdscr)
@@ -380,26 +428,86 @@ int curses_sleep(unsigned int seconds)
 }
 
 #define MAX_LINES 50
-void view_batch(struct xxxid_stats *cs, struct xxxid_stats *ps, int iter, int fd)
+#define MAX_EXITED_LINES 10
+
+/* commands whose tasks exited during the sample, heaviest I/O first */
+static void view_exited(FILE *fp)
+{
+    int len, tasks, i, k;
+    struct exited_io *e = exits_table(&len, &tasks);
+
+    if (!len)
+        return;
+
+    fprintf(fp, "Exited tasks: %d\n", tasks);
+    if (!config.f.quite)
+        fprintf(fp, "%5s %11s %11s %s\n", "TASKS", "DISK READ", "DISK WRITE", "COMMAND");
+
+    for (i = 0; i < len && i < MAX_EXITED_LINES; i++)
+    {
+        for (k = i + 1; k < len; k++)
+        {
+            if (e[k].read_bytes + e[k].write_bytes > e[i].read_bytes + e[i].write_bytes)
+            {
+                struct exited_io tmp = e[i];
+                e[i] = e[k];
+                e[k] = tmp;
+            }
+        }
+
+        double read_val = e[i].read_bytes;
+        double write_val = e[i].write_bytes;
+        char *read_str, *write_str;
+
+        if (!config.f.accumulated)
+        {
+            read_val /= params.delay;
+            write_val /= params.delay;
+        }
+
+        if (config.f.kilobytes)
+        {
+            read_val /= 1000;
+            write_val /= 1000;
+            read_str = config.f.accumulated ? "K" : "K/s";
+            write_str = config.f.accumulated ? "K" : "K/s";
+        }
+        else
+        {
+            humanize_val(&read_val, &read_str);
+            humanize_val(&write_val, &write_str);
+        }
+
+        fprintf(fp, "%5d %7.2f %-3.3s %7.2f %-3.3s %s\n",
+                e[i].tasks, read_val, read_str, write_val, write_str, e[i].comm);
+    }
+}
+
+void view_batch(struct xxxid_stats_arr *cs, struct xxxid_stats_arr *ps, int iter, int fd)
 {
     int diff_len = 0;
 
-    struct xxxid_stats *diff = create_diff(cs, ps, &diff_len);
+    struct xxxid_stats *diff;
     struct xxxid_stats *s;
 
     double total_read, total_write;
     char *str_read, *str_write;
-	
-    if(cs == NULL) return EXIT_SUCCESS;
-
-    FILE *fp = fdopen(fd, "w");
-    if(fp == NULL) return EXIT_SUCCESS;
-
-    calc_total(diff, &total_read, &total_write);
 
     /*only print result at the last iteration*/
     if(iter > 1) return;
 
+    diff = create_diff(cs, ps, &diff_len);
+    if(diff == NULL) return;
+
+    FILE *fp = fdopen(fd, "w");
+    if(fp == NULL)
+    {
+        free(diff);
+        return;
+    }
+
+    calc_total(diff, diff_len, &total_read, &total_write);
+
     humanize_val(&total_read, &str_read);
     humanize_val(&total_write, &str_write);
 
@@ -430,23 +538,26 @@ void view_batch(struct xxxid_stats *cs, struct xxxid_stats *ps, int iter, int fd
                "COMMAND"
               );
 
-    sort_diff(diff);
-    int nLines = 0;
-    for (s = diff; s; s = s->__next)
+    /* only the rows that get printed are sorted */
+    fill_sort_keys(diff, diff_len);
+    int rows = sort_diff(diff, diff_len, MAX_LINES - 1);
+    int i;
+    for (i = 0; i < rows; i++)
     {
-        struct passwd *pwd = getpwuid(s->euid);
-	if(!pwd)
-		pwd = bb_internal_getpwuid(s->euid);
+        s = &diff[i];
 
         double read_val = s->read_val;
         double write_val = s->write_val;
 
-	if(++nLines >= MAX_LINES){
-	    break;
-	}
         if (config.f.only && (!read_val || !write_val))
             continue;
 
+        /* user, priority and command are only looked up for printed rows */
+        struct passwd *pwd = getpwuid(s->euid);
+	if(!pwd)
+		pwd = bb_internal_getpwuid(s->euid);
+        const char *cmdline = s->cmdline ? s->cmdline : cached_cmdline(s->tid, s->start_time);
+
         char *read_str, *write_str;
 
         if (config.f.kilobytes)
@@ -464,7 +575,7 @@ void view_batch(struct xxxid_stats *cs, struct xxxid_stats *ps, int iter, int fd
 
         fprintf(fp,"%5i %4s %-10.10s %7.2f %-3.3s %7.2f %-3.3s %2.2f %% %2.2f %% %s\n",
                s->tid,
-               str_ioprio_ext(s->io_prio,s->tid),
+               str_ioprio_ext(get_ioprio(s->tid),s->tid),
                pwd ? pwd->pw_name : "UNKNOWN",
                read_val,
                read_str,
@@ -472,10 +583,12 @@ void view_batch(struct xxxid_stats *cs, struct xxxid_stats *ps, int iter, int fd
                write_str,
                s->swapin_val,
                s->blkio_val,
-               s->cmdline
+               cmdline ? cmdline : "<unknown>"
               );
     }
 
-    free(diff);
+    view_exited(fp);
+
+    free_diff(diff, diff_len);
     fclose(fp);
 }
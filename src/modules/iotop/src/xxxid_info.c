@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 /*
@@ -24,6 +25,16 @@
 #define MAX_MSG_SIZE 1024
 #define MAX_CPUS     32
 
+/*
+ * fetch_data() keeps up to NL_BATCH requests in flight before draining the
+ * replies, so the socket buffer must hold that many taskstats messages.  A
+ * reply that never comes (dropped on overflow) is given up on after
+ * NL_RECV_TIMEOUT seconds.
+ */
+#define NL_BATCH        256
+#define NL_RCVBUF       (1 << 20)
+#define NL_RECV_TIMEOUT 1
+
 struct msgtemplate
 {
     struct nlmsghdr n;
@@ -34,7 +45,7 @@ struct msgtemplate
 static int nl_sock = -1;
 static int nl_fam_id = 0;
 
-int send_cmd(int sock_fd, __u16 nlmsg_type, __u32 nlmsg_pid,
+int send_cmd(int sock_fd, __u16 nlmsg_type, __u32 nlmsg_pid, __u32 nlmsg_seq,
              __u8 genl_cmd, __u16 nla_type,
              void *nla_data, int nla_len)
 {
@@ -50,7 +61,7 @@ int send_cmd(int sock_fd, __u16 nlmsg_type, __u32 nlmsg_pid,
     msg.n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
     msg.n.nlmsg_type = nlmsg_type;
     msg.n.nlmsg_flags = NLM_F_REQUEST;
-    msg.n.nlmsg_seq = 0;
+    msg.n.nlmsg_seq = nlmsg_seq;
     msg.n.nlmsg_pid = nlmsg_pid;
     msg.g.cmd = genl_cmd;
     msg.g.version = 0x1;
@@ -96,7 +107,7 @@ int get_family_id(int sock_fd)
     int rep_len;
 
     strcpy(name, TASKSTATS_GENL_NAME);
-    if (send_cmd(sock_fd, GENL_ID_CTRL, getpid(), CTRL_CMD_GETFAMILY,
+    if (send_cmd(sock_fd, GENL_ID_CTRL, getpid(), 0, CTRL_CMD_GETFAMILY,
                  CTRL_ATTR_FAMILY_NAME, (void *) name,
                  strlen(TASKSTATS_GENL_NAME) + 1))
         return 0;
@@ -114,7 +125,8 @@ int get_family_id(int sock_fd)
     return id;
 }
 
-void nl_init(void)
+/* returns 0 when taskstats can be queried, -1 otherwise */
+int nl_init(void)
 {
     struct sockaddr_nl addr;
     int sock_fd = socket(PF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
@@ -128,67 +140,69 @@ void nl_init(void)
     if (bind(sock_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
         goto error;
 
-    nl_sock = sock_fd;
+    int rcvbuf = NL_RCVBUF;
+    struct timeval tv = { NL_RECV_TIMEOUT, 0 };
+
+    /* FORCE lifts the rmem_max cap but needs CAP_NET_ADMIN */
+    if (setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)))
+        setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
     nl_fam_id = get_family_id(sock_fd);
+    if (!nl_fam_id)
+    {
+        errno = ENOENT;   // kernel without CONFIG_TASKSTATS
+        goto error;
+    }
 
-    return;
+    nl_sock = sock_fd;
+    return 0;
 
 error:
     if (sock_fd > -1)
         close(sock_fd);
 
     fprintf(stderr, "nl_init: %s\n", strerror(errno));
-    exit(EXIT_FAILURE);
+    return -1;
 }
 
-int nl_xxxid_info(pid_t xxxid, int isp, struct xxxid_stats *stats)
+/*
+ * Parse the aggr_type (TASKSTATS_TYPE_AGGR_PID or _TGID) part of a taskstats
+ * message into stats, and the command name into comm when it is not NULL.
+ * Returns the pid the message is about, or -1 if it carries no statistics.
+ */
+static pid_t parse_taskstats(struct msgtemplate *msg, int rv, int aggr_type,
+                             struct xxxid_stats *stats, char *comm)
 {
-    if (nl_sock < 0)
-    {
-        perror("nl_xxxid_info");
-        exit(EXIT_FAILURE);
-    }
-
-    if (send_cmd(nl_sock, nl_fam_id, xxxid, TASKSTATS_CMD_GET,
-                 TASKSTATS_CMD_ATTR_PID, &xxxid, sizeof(pid_t)))
-    {
-        fprintf(stderr, "get_xxxid_info: %s\n", strerror(errno));
-        return -1;
-    }
-
-    stats->tid = xxxid;
-
-    struct msgtemplate msg;
-    int rv = recv(nl_sock, &msg, sizeof(msg), 0);
+    pid_t pid = -1;
+    int found = 0;
 
-    if (msg.n.nlmsg_type == NLMSG_ERROR ||
-            !NLMSG_OK((&msg.n), rv))
-    {
-        struct nlmsgerr *err = NLMSG_DATA(&msg);
-        fprintf(stderr, "fatal reply error, %d,,, pid:%d\n", err->error, xxxid);
-        fprintf(stderr, "msg.n.nlmsg_type:%d: NLMSG_ERROR:%d\n", msg.n.nlmsg_type, NLMSG_ERROR);
+    if (msg->n.nlmsg_type == NLMSG_ERROR || !NLMSG_OK((&msg->n), rv))
         return -1;
-    }
 
-    rv = GENLMSG_PAYLOAD(&msg.n);
+    rv = GENLMSG_PAYLOAD(&msg->n);
 
-    struct nlattr *na = (struct nlattr *) GENLMSG_DATA(&msg);
+    struct nlattr *na = (struct nlattr *) GENLMSG_DATA(msg);
     int len = 0;
 
     while (len < rv)
     {
         len += NLA_ALIGN(na->nla_len);
 
-        if (na->nla_type == TASKSTATS_TYPE_AGGR_TGID
-                || na->nla_type == TASKSTATS_TYPE_AGGR_PID)
+        if (na->nla_type == aggr_type)
         {
             int aggr_len = NLA_PAYLOAD(na->nla_len);
             int len2 = 0;
+            struct nlattr *aggr = (struct nlattr *) NLA_DATA(na);
 
-            na = (struct nlattr *) NLA_DATA(na);
             while (len2 < aggr_len)
             {
-                if (na->nla_type == TASKSTATS_TYPE_STATS)
+                na = (struct nlattr *) ((char *) aggr + len2);
+
+                if (na->nla_type == TASKSTATS_TYPE_PID
+                        || na->nla_type == TASKSTATS_TYPE_TGID)
+                    pid = *(__u32 *) NLA_DATA(na);
+                else if (na->nla_type == TASKSTATS_TYPE_STATS)
                 {
                     struct taskstats *ts = NLA_DATA(na);
 #define COPY(field) { stats->field = ts->field; }
@@ -198,23 +212,283 @@ int nl_xxxid_info(pid_t xxxid, int isp, struct xxxid_stats *stats)
                     COPY(blkio_delay_total);
 #undef COPY
                     stats->euid = ts->ac_uid;
+                    stats->start_time = ts->ac_btime;
+                    if (comm)
+                    {
+                        memcpy(comm, ts->ac_comm, TS_COMM_LEN);
+                        comm[TS_COMM_LEN - 1] = 0;
+                    }
+                    found = 1;
                 }
                 len2 += NLA_ALIGN(na->nla_len);
-                na = (struct nlattr *) ((char *) na + len2);
             }
         }
-        na = (struct nlattr *) ((char *) GENLMSG_DATA(&msg) + len);
+        na = (struct nlattr *) ((char *) GENLMSG_DATA(msg) + len);
+    }
+
+    return found ? pid : -1;
+}
+
+int nl_xxxid_info(pid_t xxxid, int isp, struct xxxid_stats *stats)
+{
+    if (nl_sock < 0)
+    {
+        perror("nl_xxxid_info");
+        exit(EXIT_FAILURE);
     }
 
-    stats->io_prio = get_ioprio(xxxid);
+    if (send_cmd(nl_sock, nl_fam_id, xxxid, 0, TASKSTATS_CMD_GET,
+                 TASKSTATS_CMD_ATTR_PID, &xxxid, sizeof(pid_t)))
+    {
+        fprintf(stderr, "get_xxxid_info: %s\n", strerror(errno));
+        return -1;
+    }
+
+    stats->tid = xxxid;
+
+    struct msgtemplate msg;
+    int rv = recv(nl_sock, &msg, sizeof(msg), 0);
+
+    if (rv < 0 || parse_taskstats(&msg, rv, TASKSTATS_TYPE_AGGR_PID, stats, NULL) < 0)
+    {
+        fprintf(stderr, "fatal reply error, pid:%d\n", xxxid);
+        return -1;
+    }
 
     return 0;
 }
 
+/*
+ * Query taskstats for all n tids, keeping up to NL_BATCH requests in flight
+ * instead of one send/recv round trip per task.  The reply for tids[i] is
+ * stored in out[i]; ok[i] tells whether one arrived.
+ *
+ * Sequence numbers keep increasing across batches and calls, so a reply that
+ * turns up after its recv() timed out can be told apart from the current
+ * batch and is dropped instead of being counted against it.
+ */
+static void nl_xxxid_info_batch(pid_t *tids, int n,
+                                struct xxxid_stats *out, char *ok)
+{
+    static __u32 nl_seq = 1;
+    struct msgtemplate msg;
+    int i, k, sent, rv;
+
+    if (nl_sock < 0)
+    {
+        perror("nl_xxxid_info");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(ok, 0, n);
+
+    for (i = 0; i < n; i += NL_BATCH)
+    {
+        int batch = (n - i < NL_BATCH) ? n - i : NL_BATCH;
+        __u32 base = nl_seq;
+
+        nl_seq += batch;
+
+        /* throw away replies left over from a batch that timed out */
+        while (recv(nl_sock, &msg, sizeof(msg), MSG_DONTWAIT) > 0)
+            ;
+
+        for (k = sent = 0; k < batch; k++)
+        {
+            /* the sequence number routes the reply back to its slot */
+            if (send_cmd(nl_sock, nl_fam_id, 0, base + k, TASKSTATS_CMD_GET,
+                         TASKSTATS_CMD_ATTR_PID, &tids[i + k], sizeof(pid_t)))
+                break;
+            sent++;
+        }
+
+        /* every request gets exactly one reply, data or NLMSG_ERROR */
+        while (sent > 0)
+        {
+            rv = recv(nl_sock, &msg, sizeof(msg), 0);
+            if (rv < 0)
+                break;
+
+            __u32 slot = msg.n.nlmsg_seq - base;
+            struct xxxid_stats tmp;
+
+            if (slot >= (__u32) batch)
+                continue;       // stale reply from an earlier batch
+            sent--;
+
+            memset(&tmp, 0, sizeof(tmp));
+            if (parse_taskstats(&msg, rv, TASKSTATS_TYPE_AGGR_PID, &tmp, NULL) != tids[i + slot])
+                continue;
+
+            tmp.tid = tids[i + slot];
+            out[i + slot] = tmp;
+            ok[i + slot] = 1;
+        }
+    }
+}
+
+static void exit_term(void);
+
 void nl_term(void)
 {
+    exit_term();
+
     if (nl_sock > -1)
         close(nl_sock);
+    nl_sock = -1;
+}
+
+/*
+ * Exit accounting.  Tasks that start and exit between two samples never show
+ * up in fetch_data(), so a second socket listens for the statistics the
+ * kernel sends when a task exits.  The listener is registered by the first
+ * sample of an iotop run and deregistered by nl_term() when the run ends,
+ * so the kernel does not queue exit events for an idle daemon.
+ */
+#define EXIT_RCVBUF (4 << 20)
+
+static int exit_sock = -1;
+static int exit_failed;
+static char exit_cpumask[32];
+static struct exited_io exited[EXITED_MAX];
+static int exited_len;
+static int exited_tasks;
+
+static int exit_init(void)
+{
+    struct sockaddr_nl addr;
+
+    if (exit_sock > -1 || exit_failed)
+        return exit_sock;
+
+    exit_sock = socket(PF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+    if (exit_sock < 0)
+        goto error;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(exit_sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        goto error;
+
+    int rcvbuf = EXIT_RCVBUF;
+    if (setsockopt(exit_sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)))
+        setsockopt(exit_sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    snprintf(exit_cpumask, sizeof(exit_cpumask), "0-%ld",
+             sysconf(_SC_NPROCESSORS_CONF) - 1);
+    if (send_cmd(exit_sock, nl_fam_id, 0, 0, TASKSTATS_CMD_GET,
+                 TASKSTATS_CMD_ATTR_REGISTER_CPUMASK, exit_cpumask, strlen(exit_cpumask)))
+        goto error;
+
+    return exit_sock;
+
+error:
+    fprintf(stderr, "exit_init: %s\n", strerror(errno));
+    if (exit_sock > -1)
+        close(exit_sock);
+    exit_sock = -1;
+    exit_failed = 1;
+    return -1;
+}
+
+/* Stop listening for exit events; the next run registers again. */
+static void exit_term(void)
+{
+    if (exit_sock > -1)
+    {
+        send_cmd(exit_sock, nl_fam_id, 0, 0, TASKSTATS_CMD_GET,
+                 TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK, exit_cpumask, strlen(exit_cpumask));
+        close(exit_sock);
+    }
+    exit_sock = -1;
+    exit_failed = 0;
+}
+
+static void account_exit(const char *comm, uint64_t read_bytes, uint64_t write_bytes)
+{
+    int i;
+
+    for (i = 0; i < exited_len; i++)
+        if (!strcmp(exited[i].comm, comm))
+            break;
+
+    if (i == exited_len)
+    {
+        if (exited_len == EXITED_MAX)
+            i = EXITED_MAX - 1;   // the last slot collects the overflow
+        else
+        {
+            memset(&exited[i], 0, sizeof(exited[i]));
+            strcpy(exited[i].comm, comm);
+            exited_len++;
+        }
+    }
+
+    exited[i].tasks++;
+    exited[i].read_bytes += read_bytes;
+    exited[i].write_bytes += write_bytes;
+    exited_tasks++;
+}
+
+/*
+ * Drain the exit events that arrived since the previous sample.  Only the
+ * I/O a task did after prev was taken is accounted; tasks still listed in
+ * cur were already counted by the diff.
+ */
+void exits_collect(struct xxxid_stats_arr *cur, struct xxxid_stats_arr *prev,
+                   filter_callback filter)
+{
+    struct msgtemplate msg;
+    int rv;
+
+    exited_len = exited_tasks = 0;
+
+    /* exit events need the taskstats family too */
+    if (nl_sock < 0 || exit_init() < 0)
+        return;
+
+    for (;;)
+    {
+        struct xxxid_stats s;
+        struct xxxid_stats *p;
+        char comm[TS_COMM_LEN];
+        pid_t tid;
+
+        rv = recv(exit_sock, &msg, sizeof(msg), MSG_DONTWAIT);
+        if (rv < 0)
+        {
+            /* the events lost to an overflow are simply not accounted */
+            if (errno == ENOBUFS)
+                continue;
+            break;
+        }
+
+        memset(&s, 0, sizeof(s));
+        tid = parse_taskstats(&msg, rv, TASKSTATS_TYPE_AGGR_PID, &s, comm);
+        if (tid < 0)
+            continue;
+
+        cmdline_cache_evict(tid);
+
+        s.tid = tid;
+        if (!prev || arr_find(cur, tid) || (filter && filter(&s)))
+            continue;
+
+        if ((p = arr_find(prev, tid)))
+        {
+            s.read_bytes -= (s.read_bytes > p->read_bytes) ? p->read_bytes : s.read_bytes;
+            s.write_bytes -= (s.write_bytes > p->write_bytes) ? p->write_bytes : s.write_bytes;
+        }
+
+        account_exit(comm, s.read_bytes, s.write_bytes);
+    }
+}
+
+struct exited_io *exits_table(int *len, int *tasks)
+{
+    *len = exited_len;
+    *tasks = exited_tasks;
+    return exited;
 }
 
 void dump_xxxid_stats(struct xxxid_stats *stats)
@@ -229,46 +503,74 @@ void dump_xxxid_stats(struct xxxid_stats *stats)
            stats->cmdline);
 }
 
-void free_stats(struct xxxid_stats *s)
+void free_stats_arr(struct xxxid_stats_arr *a)
 {
-    if (s->cmdline)
-        free(s->cmdline);
+    int i;
 
-    free(s);
+    if (!a)
+        return;
+
+    for (i = 0; i < a->length; i++)
+        if (a->arr[i].cmdline)
+            free(a->arr[i].cmdline);
+
+    free(a->arr);
+    free(a->hash);
+    free(a);
 }
 
-void free_stats_chain(struct xxxid_stats *chain)
+static inline unsigned int tid_hash(pid_t tid)
 {
-    while (chain)
-    {
-        struct xxxid_stats *next = chain->__next;
-
-        free_stats(chain);
-        chain = next;
-    }
+    return (unsigned int) tid * 2654435761u;
 }
 
-struct xxxid_stats *make_stats(int pid, int processes)
+struct xxxid_stats *arr_find(struct xxxid_stats_arr *a, pid_t tid)
 {
-    struct xxxid_stats *s = malloc(sizeof(struct xxxid_stats));
-    memset(s, 0, sizeof(struct xxxid_stats));
+    unsigned int mask, h;
 
-    if (nl_xxxid_info(pid, processes, s))
-        goto error;
+    if (!a || !a->hash_size)
+        return NULL;
 
-    const static char unknown[] = "<unknown>";
-    const char *cmdline = read_cmdline2(pid);
+    mask = a->hash_size - 1;
+    for (h = tid_hash(tid) & mask; a->hash[h] != -1; h = (h + 1) & mask)
+        if (a->arr[a->hash[h]].tid == tid)
+            return &a->arr[a->hash[h]];
 
-    s->cmdline = strdup(cmdline ? cmdline : unknown);
+    return NULL;
+}
+
+static void arr_index(struct xxxid_stats_arr *a)
+{
+    unsigned int mask, h;
+    int i;
 
-    return s;
+    a->hash_size = 16;
+    while (a->hash_size < 2 * a->length)
+        a->hash_size <<= 1;
 
-error:
-    free_stats(s);
-    return NULL;
+    a->hash = malloc(a->hash_size * sizeof(int));
+    if (!a->hash)
+    {
+        perror("fetch_data");
+        exit(EXIT_FAILURE);
+    }
+    memset(a->hash, -1, a->hash_size * sizeof(int));
+
+    mask = a->hash_size - 1;
+    for (i = 0; i < a->length; i++)
+    {
+        for (h = tid_hash(a->arr[i].tid) & mask; a->hash[h] != -1; h = (h + 1) & mask)
+            ;
+        a->hash[h] = i;
+    }
 }
 
-struct xxxid_stats *fetch_data(int processes, filter_callback filter)
+/*
+ * Collect the statistics of every process (or thread), from taskstats when
+ * nl_init() succeeded and from /proc/PID/io otherwise.  cmdline and io_prio
+ * are left unset: they are only looked up for the rows actually displayed.
+ */
+struct xxxid_stats_arr *fetch_data(int processes, filter_callback filter)
 {
     struct pidgen *pg = openpidgen(
                             processes ? PIDGEN_FLAGS_PROC : PIDGEN_FLAGS_TASK);
@@ -279,35 +581,63 @@ struct xxxid_stats *fetch_data(int processes, filter_callback filter)
         exit(EXIT_FAILURE);
     }
 
-    struct xxxid_stats *schain = NULL;
-    struct xxxid_stats *p = NULL;
-
+    pid_t *tids = NULL, *tgids = NULL;
+    int ntids = 0, size = 0;
     int pid;
 
     while ((pid = pidgen_next(pg)) > 0)
     {
-        struct xxxid_stats *s = make_stats(pid, processes);
-	if (!s)
-		continue;
-
-        if (filter && filter(s))
-            free_stats(s);
-        else
+        if (ntids == size)
         {
-            if (!schain)
-            {
-                schain = s;
-                p = s;
-            }
-            else
+            size = size ? 2 * size : 1024;
+            tids = realloc(tids, size * sizeof(pid_t));
+            tgids = realloc(tgids, size * sizeof(pid_t));
+            if (!tids || !tgids)
             {
-                p->__next = s;
-                p = s;
+                perror("fetch_data");
+                exit(EXIT_FAILURE);
             }
         }
+        tgids[ntids] = processes ? 0 : pidgen_tgid(pg);
+        tids[ntids++] = pid;
     }
 
     closepidgen(pg);
-    return schain;
-}
 
+    struct xxxid_stats_arr *a = calloc(1, sizeof(struct xxxid_stats_arr));
+    char *ok = malloc(ntids ? ntids : 1);
+
+    if (a)
+        a->arr = calloc(ntids ? ntids : 1, sizeof(struct xxxid_stats));
+
+    if (!a || !a->arr || !ok)
+    {
+        perror("fetch_data");
+        exit(EXIT_FAILURE);
+    }
+
+    if (nl_sock > -1)
+        nl_xxxid_info_batch(tids, ntids, a->arr, ok);
+    else
+        proc_xxxid_info_batch(tids, tgids, ntids, a->arr, ok);
+
+    int i;
+
+    /* compact in place, dropping lost replies and filtered tasks */
+    for (i = 0; i < ntids; i++)
+    {
+        if (!ok[i] || (filter && filter(&a->arr[i])))
+            continue;
+
+        if (i != a->length)
+            a->arr[a->length] = a->arr[i];
+        a->length++;
+    }
+
+    arr_index(a);
+
+    free(ok);
+    free(tgids);
+    free(tids);
+    return a;
+}
@@ -41,6 +41,17 @@ typedef struct pm_kernel   pm_kernel_t;
 typedef struct pm_process  pm_process_t;
 typedef struct pm_map      pm_map_t;
 
+/* The per-run PFN caches are flat arrays indexed by PFN, split into segments
+ * that are allocated the first time one of their frames is looked up.  A count
+ * entry holds the map count plus one and a flags entry the flags with
+ * PM_PFN_FLAGS_VALID set, so a zeroed entry reads as not cached.  That is 4
+ * bytes per frame and cache, whatever the number of processes sharing it. */
+#define PM_PFN_SEG_SHIFT 16
+#define PM_PFN_SEG_SIZE  (1 << PM_PFN_SEG_SHIFT)
+
+#define PM_PFN_FLAGS_VALID 0x80000000U
+#define PM_PFN_FLAGS_MASK  0x7fffffffU
+
 /* pm_kernel_t holds the state necessary to interface to the kernel's pagemap
  * system on a global level. */
 struct pm_kernel {
@@ -48,6 +59,22 @@ struct pm_kernel {
     int kpageflags_fd;
 
     int pagesize;
+
+    /* PFN -> count/flags caches, so that a frame shared by many processes is
+     * only looked up in the kernel once per pm_kernel_t.  Segments are
+     * installed with a compare-and-swap and entries are single words, so
+     * several threads can account processes without locking.  Frames from
+     * max_pfn on (memory hot-added since) are not cached. */
+    uint64_t max_pfn;
+    size_t nr_pfn_segs;
+    uint32_t **count_segs;
+    uint32_t **flags_segs;
+
+    /* /sys/kernel/mm/page_idle/bitmap, opened on first use, and the bitmap
+     * as last read by pm_kernel_idle_read(). */
+    int page_idle_fd;
+    uint64_t *idle_bitmap;
+    size_t idle_words;
 };
 
 /* pm_process_t holds the state necessary to interface to a particular process'
@@ -61,8 +88,19 @@ struct pm_process {
     int num_maps;
 
     int pagemap_fd;
+
+    /* Scratch space mappings are read into chunk by chunk.  Either handed
+     * in by pm_process_set_pagemap_buf() or allocated on first use (and then
+     * owned by the process). */
+    uint64_t *pagemap_buf;
+    size_t pagemap_buf_len;
+    int pagemap_buf_owned;
 };
 
+/* Number of pagemap entries (of 8 bytes each) read per chunk, which bounds the
+ * memory needed to account a mapping of any size. */
+#define PM_PAGEMAP_CHUNK 65536
+
 /* pm_map_t holds the state necessary to access information about a particular
  * mapping in a particular process. */
 struct pm_map {
@@ -87,11 +125,13 @@ int pm_kernel_create(pm_kernel_t **ker_out);
 int pm_kernel_pids(pm_kernel_t *ker, pid_t **pids_out, size_t *len);
 
 /* Get the map count (from /proc/kpagecount) of a physical frame.
- * The count is returned through *count_out. */
+ * The count is returned through *count_out.  The value is cached in ker, so
+ * later lookups of the same frame do not go back to the kernel. */
 int pm_kernel_count(pm_kernel_t *ker, uint64_t pfn, uint64_t *count_out);
 
 /* Get the page flags (from /proc/kpageflags) of a physical frame.
- * The count is returned through *flags_out. */
+ * The flags are returned through *flags_out.  Cached like pm_kernel_count;
+ * only the low 31 bits, which hold the PM_PAGE_* flags below, are kept. */
 int pm_kernel_flags(pm_kernel_t *ker, uint64_t pfn, uint64_t *flags_out);
 
 #define PM_PAGE_LOCKED     (1 <<  0)
@@ -124,6 +164,20 @@ int pm_kernel_flags(pm_kernel_t *ker, uint64_t pfn, uint64_t *flags_out);
 /* for kernels >= 3.4 */
 #define PM_PAGE_THP           (1 << 22)
 
+/* Mark every user page in the system idle through the page_idle bitmap
+ * (CONFIG_IDLE_PAGE_TRACKING).  Unlike clear_refs this leaves the page
+ * tables and reclaim state of the processes alone. */
+int pm_kernel_idle_mark(pm_kernel_t *ker);
+
+/* Snapshot the page_idle bitmap: pages touched since pm_kernel_idle_mark()
+ * have their bit cleared again. */
+int pm_kernel_idle_read(pm_kernel_t *ker);
+
+/* Whether the frame was still idle in the last pm_kernel_idle_read(). */
+#define pm_kernel_idle(ker, pfn) \
+    ((pfn) / 64 < (ker)->idle_words && \
+     (((ker)->idle_bitmap[(pfn) / 64] >> ((pfn) % 64)) & 1))
+
 /* Destroy a pm_kernel_t. */
 int pm_kernel_destroy(pm_kernel_t *ker);
 
@@ -134,6 +188,12 @@ int pm_kernel_destroy(pm_kernel_t *ker);
  * Takes a pm_kernel_t, and the PID of the process. */
 int pm_process_create(pm_kernel_t *ker, pid_t pid, pm_process_t **proc_out);
 
+/* Let the usage and working set functions read pagemap entries into buf
+ * (len entries long) instead of allocating a scratch buffer of their own.
+ * The buffer stays owned by the caller, who may hand it to one process after
+ * another but must not share it between processes used concurrently. */
+void pm_process_set_pagemap_buf(pm_process_t *proc, uint64_t *buf, size_t len);
+
 /* Get the total memory usage of a process and store in *usage_out. */
 int pm_process_usage(pm_process_t *proc, pm_memusage_t *usage_out);
 
@@ -146,6 +206,10 @@ int pm_process_usage_flags(pm_process_t *proc, pm_memusage_t *usage_out,
  * (if reset != 0). */
 int pm_process_workingset(pm_process_t *proc, pm_memusage_t *ws_out, int reset);
 
+/* Get the working set of a process as the pages it touched between
+ * pm_kernel_idle_mark() and pm_kernel_idle_read(). */
+int pm_process_idle_workingset(pm_process_t *proc, pm_memusage_t *ws_out);
+
 /* Get the PFNs corresponding to a range of virtual addresses.
  * The array of PFNs is returned through *range_out, and the caller has the 
  * responsibility to free it. */
@@ -153,6 +217,15 @@ int pm_process_pagemap_range(pm_process_t *proc,
                              uint64_t low, uint64_t hi,
                              uint64_t **range_out, size_t *len);
 
+/* Like pm_process_pagemap_range, but reads into the caller's buffer, which
+ * must hold (hi - low) / pagesize entries. */
+int pm_process_pagemap_range_buf(pm_process_t *proc,
+                                 uint64_t low, uint64_t hi,
+                                 uint64_t *range, size_t *len);
+
+/* Get the scratch buffer of proc, allocating it on first use. */
+int pm_process_scratch(pm_process_t *proc, uint64_t **buf_out, size_t *len);
+
 #define _BITS(x, offset, bits) (((x) >> offset) & ((1LL << (bits)) - 1))
 
 #define PM_PAGEMAP_PRESENT(x)     (_BITS(x, 63, 1))
@@ -171,6 +244,20 @@ int pm_process_maps(pm_process_t *proc, pm_map_t ***maps_out, size_t *len);
 /* Destroy a pm_process_t. */
 int pm_process_destroy(pm_process_t *proc);
 
+/* Upper bound on the threads used by pm_parallel_for(). */
+#define PM_MAX_WORKERS 16
+
+/* Called by pm_parallel_for() for index i, with the pagemap scratch buffer
+ * (buf_len entries, possibly none) owned by the calling worker thread. */
+typedef void (*pm_parallel_fn)(void *arg, size_t i,
+                               uint64_t *buf, size_t buf_len);
+
+/* Call fn for every index in [0, n), spread over one thread per online CPU
+ * (at most PM_MAX_WORKERS, the caller being one of them).  Returns once all
+ * calls are done.  Indices are claimed in increasing order but may complete
+ * in any order, so fn should store results by index. */
+void pm_parallel_for(size_t n, pm_parallel_fn fn, void *arg);
+
 /* Get the name, flags, start/end address, or offset of a map. */
 #define pm_map_name(map)   ((map)->name)
 #define pm_map_flags(map)  ((map)->flags)
@@ -198,4 +285,7 @@ int pm_map_usage_flags(pm_map_t *map, pm_memusage_t *usage_out,
 /* Get the working set of this map alone. */
 int pm_map_workingset(pm_map_t *map, pm_memusage_t *ws_out);
 
+/* Get the page_idle based working set of this map alone. */
+int pm_map_idle_workingset(pm_map_t *map, pm_memusage_t *ws_out);
+
 #endif
@@ -0,0 +1,424 @@
+/*
+ * Copyright (C) 2017 The Lep Open Source Project
+ *
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "pagemap.h"
+
+/* Usage of one VMA, or of all VMAs with one name in one process. */
+struct mapping_info {
+    char *name;
+    pid_t pid;
+    uint64_t start;
+    uint64_t end;
+    int flags;
+    pm_memusage_t usage;
+};
+
+/* The mappings found in the process at the same index of the PID list. */
+struct proc_mappings {
+    struct mapping_info *mappings;
+    size_t num_mappings;
+};
+
+/* All processes' mappings of one name, as a run in the sorted mapping array. */
+struct library_info {
+    const char *name;
+    pm_memusage_t usage;
+    size_t first;
+    size_t count;
+};
+
+struct collect_ctx {
+    pm_kernel_t *ker;
+    pid_t *pids;
+    struct proc_mappings *results;
+    bool per_vma;
+};
+
+static void usage(char *myname);
+static int getprocname(pid_t pid, char *buf, int len);
+
+/* Offset of the sort key within pm_memusage_t, and the sort direction. */
+static size_t sort_field = offsetof(pm_memusage_t, pss);
+static int order = -1;
+
+#define USAGE_FIELD(u) (*(size_t *)((char *)(u) + sort_field))
+
+static int usagecmp(const pm_memusage_t *a, const pm_memusage_t *b) {
+    size_t x = USAGE_FIELD(a), y = USAGE_FIELD(b);
+
+    return order * ((x > y) - (x < y));
+}
+
+static int sort_mappings_by_usage(const void *a, const void *b) {
+    return usagecmp(&((const struct mapping_info *)a)->usage,
+                    &((const struct mapping_info *)b)->usage);
+}
+
+/* By name, then by usage, so every library becomes one presorted run. */
+static int sort_mappings_by_name(const void *a, const void *b) {
+    const struct mapping_info *ma = a, *mb = b;
+    int cmp = strcmp(ma->name, mb->name);
+
+    return cmp ? cmp : sort_mappings_by_usage(a, b);
+}
+
+/* Within one process only: by name, then by address. */
+static int sort_mappings_by_name_addr(const void *a, const void *b) {
+    const struct mapping_info *ma = a, *mb = b;
+    int cmp = strcmp(ma->name, mb->name);
+
+    if (cmp)
+        return cmp;
+    return (ma->start > mb->start) - (ma->start < mb->start);
+}
+
+static int sort_libraries(const void *a, const void *b) {
+    return usagecmp(&((const struct library_info *)a)->usage,
+                    &((const struct library_info *)b)->usage);
+}
+
+static void free_mappings(struct mapping_info *mappings, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        free(mappings[i].name);
+    free(mappings);
+}
+
+/* Fold the mappings of one process that share a name into the first of them,
+ * which keeps the lowest start address. */
+static size_t merge_by_name(struct mapping_info *mappings, size_t n) {
+    size_t i, j;
+
+    if (!n)
+        return 0;
+
+    qsort(mappings, n, sizeof(*mappings), sort_mappings_by_name_addr);
+
+    for (i = 0, j = 1; j < n; j++) {
+        if (!strcmp(mappings[i].name, mappings[j].name)) {
+            pm_memusage_add(&mappings[i].usage, &mappings[j].usage);
+            mappings[i].end = mappings[j].end;
+            free(mappings[j].name);
+        } else {
+            mappings[++i] = mappings[j];
+        }
+    }
+
+    return i + 1;
+}
+
+static void collect_one(void *arg, size_t i, uint64_t *buf, size_t buf_len) {
+    struct collect_ctx *ctx = arg;
+    struct proc_mappings *res = &ctx->results[i];
+    struct mapping_info *mappings;
+    pm_process_t *proc;
+    pm_map_t **maps;
+    pm_memusage_t map_usage;
+    size_t num_maps, j, n;
+    const char *name;
+    int error;
+
+    error = pm_process_create(ctx->ker, ctx->pids[i], &proc);
+    if (error) {
+        fprintf(stderr, "warning: could not create process interface for %d\n", ctx->pids[i]);
+        return;
+    }
+    pm_process_set_pagemap_buf(proc, buf, buf_len);
+
+    error = pm_process_maps(proc, &maps, &num_maps);
+    if (error || !num_maps) {
+        pm_process_destroy(proc);
+        return;
+    }
+
+    mappings = calloc(num_maps, sizeof(*mappings));
+    if (!mappings)
+        goto out;
+
+    for (j = n = 0; j < num_maps; j++) {
+        error = pm_map_usage(maps[j], &map_usage);
+        if (error) {
+            fprintf(stderr, "warning: could not read usage for map %s in %d\n",
+                    pm_map_name(maps[j]), ctx->pids[i]);
+            continue;
+        }
+        if (!map_usage.rss && !map_usage.swap)
+            continue;
+
+        name = pm_map_name(maps[j])[0] ? pm_map_name(maps[j]) : "[anon]";
+        mappings[n].name = strdup(name);
+        if (!mappings[n].name)
+            break;
+        mappings[n].pid = ctx->pids[i];
+        mappings[n].start = pm_map_start(maps[j]);
+        mappings[n].end = pm_map_end(maps[j]);
+        mappings[n].flags = pm_map_flags(maps[j]);
+        mappings[n].usage = map_usage;
+        n++;
+    }
+
+    if (!ctx->per_vma)
+        n = merge_by_name(mappings, n);
+
+    res->mappings = mappings;
+    res->num_mappings = n;
+
+out:
+    free(maps);
+    pm_process_destroy(proc);
+}
+
+/* Flatten the per-process results into one array, which takes over the
+ * mapping names. */
+static struct mapping_info *gather(struct proc_mappings *results,
+                                   size_t num_procs, size_t *len) {
+    struct mapping_info *all;
+    size_t i, n;
+
+    for (i = n = 0; i < num_procs; i++)
+        n += results[i].num_mappings;
+
+    all = malloc((n ? n : 1) * sizeof(*all));
+    if (!all)
+        return NULL;
+
+    for (i = n = 0; i < num_procs; i++) {
+        if (results[i].num_mappings)
+            memcpy(&all[n], results[i].mappings,
+                   results[i].num_mappings * sizeof(*all));
+        n += results[i].num_mappings;
+        free(results[i].mappings);
+        results[i].mappings = NULL;
+    }
+
+    *len = n;
+    return all;
+}
+
+static void print_usage_cols(FILE *fp, pm_memusage_t *u, bool has_swap) {
+    fprintf(fp, "%7zuK  %6zuK  %6zuK  %6zuK  ",
+            u->vss / 1024, u->rss / 1024, u->pss / 1024, u->uss / 1024);
+    if (has_swap)
+        fprintf(fp, "%6zuK  ", u->swap / 1024);
+}
+
+static void print_vmas(FILE *fp, struct mapping_info *all, size_t n,
+                       size_t max_lines, bool has_swap) {
+    size_t i;
+
+    qsort(all, n, sizeof(*all), sort_mappings_by_usage);
+
+    fprintf(fp, "%5s  %-33s  %4s  %8s  %7s  %7s  %7s  ",
+            "PID", "Range", "Perm", "Vss", "Rss", "Pss", "Uss");
+    if (has_swap)
+        fprintf(fp, "%7s  ", "Swap");
+    fprintf(fp, "Name\n");
+
+    for (i = 0; i < n && i < max_lines; i++) {
+        fprintf(fp, "%5d  %016" PRIx64 "-%016" PRIx64 "  %c%c%c   ",
+                all[i].pid, all[i].start, all[i].end,
+                (all[i].flags & PM_MAP_READ) ? 'r' : '-',
+                (all[i].flags & PM_MAP_WRITE) ? 'w' : '-',
+                (all[i].flags & PM_MAP_EXEC) ? 'x' : '-');
+        print_usage_cols(fp, &all[i].usage, has_swap);
+        fprintf(fp, "%s\n", all[i].name);
+    }
+}
+
+static void print_libraries(FILE *fp, struct mapping_info *all, size_t n,
+                            size_t max_libs, size_t max_procs, bool has_swap) {
+    struct library_info *libs;
+    size_t num_libs, i, j;
+    char cmdline[256];
+
+    qsort(all, n, sizeof(*all), sort_mappings_by_name);
+
+    libs = malloc((n ? n : 1) * sizeof(*libs));
+    if (!libs) {
+        fprintf(stderr, "malloc: %s\n", strerror(errno));
+        return;
+    }
+
+    for (i = num_libs = 0; i < n; i++) {
+        if (!num_libs || strcmp(libs[num_libs - 1].name, all[i].name)) {
+            libs[num_libs].name = all[i].name;
+            pm_memusage_zero(&libs[num_libs].usage);
+            libs[num_libs].first = i;
+            libs[num_libs].count = 0;
+            num_libs++;
+        }
+        pm_memusage_add(&libs[num_libs - 1].usage, &all[i].usage);
+        libs[num_libs - 1].count++;
+    }
+
+    qsort(libs, num_libs, sizeof(*libs), sort_libraries);
+
+    fprintf(fp, "%8s  %7s  %7s  %7s  %7s  ", "Vss", "Rss", "Pss", "Uss", "Procs");
+    if (has_swap)
+        fprintf(fp, "%7s  ", "Swap");
+    fprintf(fp, "Name/PID\n");
+
+    for (i = 0; i < num_libs && i < max_libs; i++) {
+        print_usage_cols(fp, &libs[i].usage, has_swap);
+        fprintf(fp, "%5zu   %s\n", libs[i].count, libs[i].name);
+
+        /* The run of each library is already sorted by usage. */
+        for (j = 0; j < libs[i].count && j < max_procs; j++) {
+            struct mapping_info *m = &all[libs[i].first + j];
+
+            getprocname(m->pid, cmdline, (int)sizeof(cmdline));
+            print_usage_cols(fp, &m->usage, has_swap);
+            fprintf(fp, "%5s     %s [%d]\n", "", cmdline, m->pid);
+        }
+    }
+
+    free(libs);
+}
+
+#define MAX_LIBS 30
+#define MAX_PROCS_PER_LIB 5
+#define MAX_VMAS 100
+int librank_main(int argc, char *argv[], int out_fd) {
+    pm_kernel_t *ker;
+    struct collect_ctx ctx;
+    struct proc_mappings *results;
+    struct mapping_info *all;
+    pid_t *pids;
+    size_t num_procs, num_all, i;
+    size_t max_lines = 0;
+    bool per_vma = false;
+    bool has_swap = false;
+    int error;
+    int arg;
+
+    FILE *fp = fdopen(out_fd, "w");
+    if (fp == NULL) return EXIT_SUCCESS;
+
+    sort_field = offsetof(pm_memusage_t, pss);
+    order = -1;
+
+    for (arg = 1; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "-v")) { sort_field = offsetof(pm_memusage_t, vss); continue; }
+        if (!strcmp(argv[arg], "-r")) { sort_field = offsetof(pm_memusage_t, rss); continue; }
+        if (!strcmp(argv[arg], "-p")) { sort_field = offsetof(pm_memusage_t, pss); continue; }
+        if (!strcmp(argv[arg], "-u")) { sort_field = offsetof(pm_memusage_t, uss); continue; }
+        if (!strcmp(argv[arg], "-s")) { sort_field = offsetof(pm_memusage_t, swap); continue; }
+        if (!strcmp(argv[arg], "-R")) { order *= -1; continue; }
+        if (!strcmp(argv[arg], "-V")) { per_vma = true; continue; }
+        if (!strcmp(argv[arg], "-n") && arg + 1 < argc) {
+            max_lines = strtoul(argv[++arg], NULL, 10);
+            continue;
+        }
+        fprintf(stderr, "Invalid argument \"%s\".\n", argv[arg]);
+        usage(argv[0]);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    error = pm_kernel_create(&ker);
+    if (error) {
+        fprintf(stderr, "Error creating kernel interface -- "
+                        "does this kernel have pagemap?\n");
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    error = pm_kernel_pids(ker, &pids, &num_procs);
+    if (error) {
+        fprintf(stderr, "Error listing processes.\n");
+        pm_kernel_destroy(ker);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    results = calloc(num_procs ? num_procs : 1, sizeof(*results));
+    if (!results) {
+        fprintf(stderr, "calloc: %s\n", strerror(errno));
+        free(pids);
+        pm_kernel_destroy(ker);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    /* Frames shared by many processes are looked up once through the
+     * pm_kernel_t cache, however many processes map them. */
+    ctx.ker = ker;
+    ctx.pids = pids;
+    ctx.results = results;
+    ctx.per_vma = per_vma;
+    pm_parallel_for(num_procs, collect_one, &ctx);
+
+    all = gather(results, num_procs, &num_all);
+    free(results);
+    free(pids);
+    if (!all) {
+        fprintf(stderr, "malloc: %s\n", strerror(errno));
+        pm_kernel_destroy(ker);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < num_all; i++) {
+        if (all[i].usage.swap) {
+            has_swap = true;
+            break;
+        }
+    }
+
+    if (per_vma)
+        print_vmas(fp, all, num_all, max_lines ? max_lines : MAX_VMAS, has_swap);
+    else
+        print_libraries(fp, all, num_all, max_lines ? max_lines : MAX_LIBS,
+                        MAX_PROCS_PER_LIB, has_swap);
+
+    free_mappings(all, num_all);
+    fclose(fp);
+
+    pm_kernel_destroy(ker);
+    return 0;
+}
+
+static void usage(char *myname) {
+    fprintf(stderr, "Usage: %s [ -V ] [ -n <count> ] [ -v | -r | -p | -u | -s ] [ -R ]\n"
+                    "    -V  List single mappings instead of libraries.\n"
+                    "    -n  Number of libraries (or mappings) to list.\n"
+                    "    -v  Sort by VSS.\n"
+                    "    -r  Sort by RSS.\n"
+                    "    -p  Sort by PSS.\n"
+                    "    -u  Sort by USS.\n"
+                    "    -s  Sort by swap.\n"
+                    "        (Default sort order is PSS.)\n"
+                    "    -R  Reverse sort order (default is descending).\n",
+    myname);
+}
+
+/* Get the command line of pid into buf, or "<unknown>" if it has gone. */
+static int getprocname(pid_t pid, char *buf, int len) {
+    char filename[64];
+    FILE *f;
+
+    snprintf(filename, sizeof(filename), "/proc/%d/cmdline", pid);
+    f = fopen(filename, "r");
+    if (f) {
+        if (fgets(buf, len, f)) {
+            fclose(f);
+            return 0;
+        }
+        fclose(f);
+    }
+
+    snprintf(buf, len, "%s", "<unknown>");
+    return -1;
+}
@@ -19,12 +19,29 @@
 #include <fcntl.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "pagemap.h"
 
+/* The number of frames, found by bisecting /proc/kpagecount: reads past the
+ * last frame return nothing. */
+static uint64_t probe_max_pfn(int fd) {
+    uint64_t lo = 0, hi = 1ULL << 40, mid, word;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (pread(fd, &word, sizeof(word), mid * sizeof(word)) == sizeof(word))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
 int pm_kernel_create(pm_kernel_t **ker_out) {
     pm_kernel_t *ker;
     int error;
@@ -52,6 +69,19 @@ int pm_kernel_create(pm_kernel_t **ker_out) {
     }
 
     ker->pagesize = getpagesize();
+    ker->page_idle_fd = -1;
+
+    ker->max_pfn = probe_max_pfn(ker->kpagecount_fd);
+    ker->nr_pfn_segs = (ker->max_pfn + PM_PFN_SEG_SIZE - 1) >> PM_PFN_SEG_SHIFT;
+    ker->count_segs = calloc(ker->nr_pfn_segs, sizeof(*ker->count_segs));
+    ker->flags_segs = calloc(ker->nr_pfn_segs, sizeof(*ker->flags_segs));
+    if (!ker->count_segs || !ker->flags_segs) {
+        /* Run uncached */
+        free(ker->count_segs);
+        free(ker->flags_segs);
+        ker->count_segs = ker->flags_segs = NULL;
+        ker->max_pfn = ker->nr_pfn_segs = 0;
+    }
 
     *ker_out = ker;
 
@@ -113,45 +143,196 @@ int pm_kernel_pids(pm_kernel_t *ker, pid_t **pids_out, size_t *len) {
     return 0;
 }
 
-int pm_kernel_count(pm_kernel_t *ker, uint64_t pfn, uint64_t *count_out) {
-    off64_t off;
+static int read_pfn_word(int fd, uint64_t pfn, uint64_t *out) {
+    ssize_t ret;
+
+    ret = pread(fd, out, sizeof(uint64_t), pfn * sizeof(uint64_t));
+    if (ret < (ssize_t)sizeof(uint64_t))
+        return (ret < 0) ? errno : -1;
+
+    return 0;
+}
+
+/* Segment of segs holding pfn, allocated on first use.  When two threads
+ * race, the loser frees its copy and uses the winner's. */
+static uint32_t *pfn_cache_seg(uint32_t **segs, uint64_t pfn) {
+    uint32_t **slot = &segs[pfn >> PM_PFN_SEG_SHIFT];
+    uint32_t *seg;
+
+    if ((seg = *(uint32_t *volatile *)slot))
+        return seg;
+
+    seg = calloc(PM_PFN_SEG_SIZE, sizeof(*seg));
+    if (!seg)
+        return NULL;
+    if (!__sync_bool_compare_and_swap(slot, NULL, seg)) {
+        free(seg);
+        seg = *(uint32_t *volatile *)slot;
+    }
+
+    return seg;
+}
+
+/* Look pfn up in segs, reading it from fd on a miss.  Counts are cached plus
+ * one, flags with PM_PFN_FLAGS_VALID, so that 0 means not cached. */
+static int pfn_cache_lookup(pm_kernel_t *ker, uint32_t **segs, uint64_t pfn,
+                            int fd, int is_flags, uint64_t *out) {
+    volatile uint32_t *e;
+    uint32_t *seg;
+    uint32_t v;
+    int error;
+
+    if (pfn >= ker->max_pfn || !(seg = pfn_cache_seg(segs, pfn))) {
+        error = read_pfn_word(fd, pfn, out);
+        if (!error && is_flags)
+            *out &= PM_PFN_FLAGS_MASK;
+        return error;
+    }
+
+    e = &seg[pfn & (PM_PFN_SEG_SIZE - 1)];
+    if ((v = *e)) {
+        *out = is_flags ? (v & PM_PFN_FLAGS_MASK) : v - 1;
+        return 0;
+    }
+
+    error = read_pfn_word(fd, pfn, out);
+    if (error)
+        return error;
+
+    if (is_flags) {
+        *out &= PM_PFN_FLAGS_MASK;
+        *e = *out | PM_PFN_FLAGS_VALID;
+    } else if (*out < UINT32_MAX) {
+        *e = *out + 1;
+    }
 
+    return 0;
+}
+
+int pm_kernel_count(pm_kernel_t *ker, uint64_t pfn, uint64_t *count_out) {
     if (!ker || !count_out)
         return -1;
 
-    off = lseek64(ker->kpagecount_fd, pfn * sizeof(uint64_t), SEEK_SET);
-    if (off == (off_t)-1)
-        return errno;
-    if (read(ker->kpagecount_fd, count_out, sizeof(uint64_t)) <
-        (ssize_t)sizeof(uint64_t))
-        return errno;
+    return pfn_cache_lookup(ker, ker->count_segs, pfn, ker->kpagecount_fd, 0,
+                            count_out);
+}
+
+int pm_kernel_flags(pm_kernel_t *ker, uint64_t pfn, uint64_t *flags_out) {
+    if (!ker || !flags_out)
+        return -1;
+
+    return pfn_cache_lookup(ker, ker->flags_segs, pfn, ker->kpageflags_fd, 1,
+                            flags_out);
+}
+
+#define IDLE_CHUNK_WORDS 8192
+
+static int open_page_idle(pm_kernel_t *ker) {
+    if (ker->page_idle_fd < 0) {
+        ker->page_idle_fd = open("/sys/kernel/mm/page_idle/bitmap", O_RDWR);
+        if (ker->page_idle_fd < 0)
+            return errno;
+    }
 
     return 0;
 }
 
-int pm_kernel_flags(pm_kernel_t *ker, uint64_t pfn, uint64_t *flags_out) {
-    off64_t off;
+int pm_kernel_idle_mark(pm_kernel_t *ker) {
+    uint64_t ones[IDLE_CHUNK_WORDS];
+    off_t off;
+    ssize_t ret;
+    int error;
 
-    if (!ker || !flags_out)
+    if (!ker)
         return -1;
 
-    off = lseek64(ker->kpageflags_fd, pfn * sizeof(uint64_t), SEEK_SET);
-    if (off == (off_t)-1)
+    error = open_page_idle(ker);
+    if (error)
+        return error;
+
+    memset(ones, 0xff, sizeof(ones));
+
+    /* The kernel skips frames it cannot track, and fails with ENXIO past
+     * the last one. */
+    for (off = 0; ; off += ret) {
+        ret = pwrite(ker->page_idle_fd, ones, sizeof(ones), off);
+        if (ret <= 0)
+            break;
+    }
+    if (ret < 0 && errno != ENXIO)
         return errno;
-    if (read(ker->kpageflags_fd, flags_out, sizeof(uint64_t)) <
-        (ssize_t)sizeof(uint64_t))
+
+    return 0;
+}
+
+int pm_kernel_idle_read(pm_kernel_t *ker) {
+    uint64_t *bitmap;
+    size_t words, size;
+    ssize_t ret;
+    int error;
+
+    if (!ker)
+        return -1;
+
+    error = open_page_idle(ker);
+    if (error)
+        return error;
+
+    bitmap = ker->idle_bitmap;
+    size = ker->idle_bitmap ? ker->idle_words : 0;
+    words = 0;
+
+    for (;;) {
+        if (words + IDLE_CHUNK_WORDS > size) {
+            uint64_t *new_bitmap;
+
+            size = size ? 2 * size : 16 * IDLE_CHUNK_WORDS;
+            new_bitmap = realloc(bitmap, size * sizeof(uint64_t));
+            if (!new_bitmap) {
+                error = errno;
+                free(bitmap);
+                ker->idle_bitmap = NULL;
+                ker->idle_words = 0;
+                return error;
+            }
+            bitmap = new_bitmap;
+        }
+
+        ret = pread(ker->page_idle_fd, &bitmap[words],
+                    IDLE_CHUNK_WORDS * sizeof(uint64_t),
+                    words * sizeof(uint64_t));
+        if (ret <= 0)
+            break;
+        words += ret / sizeof(uint64_t);
+    }
+
+    ker->idle_bitmap = bitmap;
+    ker->idle_words = words;
+
+    if (ret < 0 && errno != ENXIO)
         return errno;
 
     return 0;
 }
 
 int pm_kernel_destroy(pm_kernel_t *ker) {
+    size_t i;
+
     if (!ker)
         return -1;
 
     close(ker->kpagecount_fd);
     close(ker->kpageflags_fd);
+    if (ker->page_idle_fd >= 0)
+        close(ker->page_idle_fd);
+    free(ker->idle_bitmap);
 
+    for (i = 0; i < ker->nr_pfn_segs; i++) {
+        free(ker->count_segs[i]);
+        free(ker->flags_segs[i]);
+    }
+    free(ker->count_segs);
+    free(ker->flags_segs);
     free(ker);
 
     return 0;
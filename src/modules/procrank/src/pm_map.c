@@ -19,6 +19,8 @@
 
 #include "pagemap.h"
 
+#include "pm_map.h"
+
 int pm_map_pagemap(pm_map_t *map, uint64_t **pagemap_out, size_t *len) {
     if (!map)
         return -1;
@@ -27,9 +29,43 @@ int pm_map_pagemap(pm_map_t *map, uint64_t **pagemap_out, size_t *len) {
                                     pagemap_out, len);
 }
 
+/* Read the next chunk of map's pagemap, starting at virtual address addr, into
+ * the process' scratch buffer.  *len is 0 once the end of the mapping (or of
+ * the readable pagemap) is reached. */
+static int map_pagemap_chunk(pm_map_t *map, uint64_t addr,
+                             uint64_t **pagemap_out, size_t *len) {
+    pm_process_t *proc = map->proc;
+    uint64_t *buf;
+    size_t buf_len;
+    uint64_t numpages;
+    int error;
+
+    if (addr >= map->end) {
+        *len = 0;
+        return 0;
+    }
+
+    error = pm_process_scratch(proc, &buf, &buf_len);
+    if (error) return error;
+
+    if (buf_len > PM_PAGEMAP_CHUNK)
+        buf_len = PM_PAGEMAP_CHUNK;
+
+    numpages = (map->end - addr) / proc->ker->pagesize;
+    if (numpages > buf_len)
+        numpages = buf_len;
+
+    *pagemap_out = buf;
+
+    return pm_process_pagemap_range_buf(proc, addr,
+                                        addr + numpages * proc->ker->pagesize,
+                                        buf, len);
+}
+
 int pm_map_usage_flags(pm_map_t *map, pm_memusage_t *usage_out,
                         uint64_t flags_mask, uint64_t required_flags) {
     uint64_t *pagemap;
+    uint64_t addr;
     size_t len, i;
     uint64_t count;
     pm_memusage_t usage;
@@ -38,48 +74,46 @@ int pm_map_usage_flags(pm_map_t *map, pm_memusage_t *usage_out,
     if (!map || !usage_out)
         return -1;
 
-    error = pm_map_pagemap(map, &pagemap, &len);
-    if (error) return error;
-
     pm_memusage_zero(&usage);
 
-    for (i = 0; i < len; i++) {
-        usage.vss += map->proc->ker->pagesize;
-
-        if (!PM_PAGEMAP_PRESENT(pagemap[i]))
-            continue;
-
-        if (!PM_PAGEMAP_SWAPPED(pagemap[i])) {
-            if (flags_mask) {
-                uint64_t flags;
-                error = pm_kernel_flags(map->proc->ker, PM_PAGEMAP_PFN(pagemap[i]),
-                                        &flags);
-                if (error) goto out;
-
-                if ((flags & flags_mask) != required_flags)
-                    continue;
+    for (addr = map->start; ; addr += len * map->proc->ker->pagesize) {
+        error = map_pagemap_chunk(map, addr, &pagemap, &len);
+        if (error) return error;
+        if (!len) break;
+
+        for (i = 0; i < len; i++) {
+            usage.vss += map->proc->ker->pagesize;
+
+            if (!PM_PAGEMAP_PRESENT(pagemap[i]))
+                continue;
+
+            if (!PM_PAGEMAP_SWAPPED(pagemap[i])) {
+                if (flags_mask) {
+                    uint64_t flags;
+                    error = pm_kernel_flags(map->proc->ker, PM_PAGEMAP_PFN(pagemap[i]),
+                                            &flags);
+                    if (error) return error;
+
+                    if ((flags & flags_mask) != required_flags)
+                        continue;
+                }
+
+                error = pm_kernel_count(map->proc->ker, PM_PAGEMAP_PFN(pagemap[i]),
+                                        &count);
+                if (error) return error;
+
+                usage.rss += (count >= 1) ? map->proc->ker->pagesize : (0);
+                usage.pss += (count >= 1) ? (map->proc->ker->pagesize / count) : (0);
+                usage.uss += (count == 1) ? (map->proc->ker->pagesize) : (0);
+            } else {
+                usage.swap += map->proc->ker->pagesize;
             }
-
-            error = pm_kernel_count(map->proc->ker, PM_PAGEMAP_PFN(pagemap[i]),
-                                    &count);
-            if (error) goto out;
-
-            usage.rss += (count >= 1) ? map->proc->ker->pagesize : (0);
-            usage.pss += (count >= 1) ? (map->proc->ker->pagesize / count) : (0);
-            usage.uss += (count == 1) ? (map->proc->ker->pagesize) : (0);
-        } else {
-            usage.swap += map->proc->ker->pagesize;
         }
     }
 
     memcpy(usage_out, &usage, sizeof(usage));
 
-    error = 0;
-
-out:    
-    free(pagemap);
-
-    return error;
+    return 0;
 }
 
 int pm_map_usage(pm_map_t *map, pm_memusage_t *usage_out) {
@@ -88,6 +122,7 @@ int pm_map_usage(pm_map_t *map, pm_memusage_t *usage_out) {
 
 int pm_map_workingset(pm_map_t *map, pm_memusage_t *ws_out) {
     uint64_t *pagemap;
+    uint64_t addr;
     size_t len, i;
     uint64_t count, flags;
     pm_memusage_t ws;
@@ -96,36 +131,76 @@ int pm_map_workingset(pm_map_t *map, pm_memusage_t *ws_out) {
     if (!map || !ws_out)
         return -1;
 
-    error = pm_map_pagemap(map, &pagemap, &len);
-    if (error) return error;
-
     pm_memusage_zero(&ws);
-    
-    for (i = 0; i < len; i++) {
-        error = pm_kernel_flags(map->proc->ker, PM_PAGEMAP_PFN(pagemap[i]),
-                                &flags);
-        if (error) goto out;
-
-        if (!(flags & PM_PAGE_REFERENCED)) 
-            continue;
-
-        error = pm_kernel_count(map->proc->ker, PM_PAGEMAP_PFN(pagemap[i]),
-                                &count);
-        if (error) goto out;
-
-        ws.vss += map->proc->ker->pagesize;
-        if( PM_PAGEMAP_SWAPPED(pagemap[i]) ) continue;
-        ws.rss += (count >= 1) ? (map->proc->ker->pagesize) : (0);
-        ws.pss += (count >= 1) ? (map->proc->ker->pagesize / count) : (0);
-        ws.uss += (count == 1) ? (map->proc->ker->pagesize) : (0);
+
+    for (addr = map->start; ; addr += len * map->proc->ker->pagesize) {
+        error = map_pagemap_chunk(map, addr, &pagemap, &len);
+        if (error) return error;
+        if (!len) break;
+
+        for (i = 0; i < len; i++) {
+            error = pm_kernel_flags(map->proc->ker, PM_PAGEMAP_PFN(pagemap[i]),
+                                    &flags);
+            if (error) goto out;
+
+            if (!(flags & PM_PAGE_REFERENCED)) 
+                continue;
+
+            error = pm_kernel_count(map->proc->ker, PM_PAGEMAP_PFN(pagemap[i]),
+                                    &count);
+            if (error) goto out;
+
+            ws.vss += map->proc->ker->pagesize;
+            if( PM_PAGEMAP_SWAPPED(pagemap[i]) ) continue;
+            ws.rss += (count >= 1) ? (map->proc->ker->pagesize) : (0);
+            ws.pss += (count >= 1) ? (map->proc->ker->pagesize / count) : (0);
+            ws.uss += (count == 1) ? (map->proc->ker->pagesize) : (0);
+        }
     }
 
     memcpy(ws_out, &ws, sizeof(ws));
 
-    error = 0;
-
 out:
-    free(pagemap);
+    return 0;
+}
+
+int pm_map_idle_workingset(pm_map_t *map, pm_memusage_t *ws_out) {
+    uint64_t *pagemap;
+    uint64_t addr, pfn;
+    size_t len, i;
+    uint64_t count;
+    pm_memusage_t ws;
+    int error;
+
+    if (!map || !ws_out)
+        return -1;
+
+    pm_memusage_zero(&ws);
+
+    for (addr = map->start; ; addr += len * map->proc->ker->pagesize) {
+        error = map_pagemap_chunk(map, addr, &pagemap, &len);
+        if (error) return error;
+        if (!len) break;
+
+        for (i = 0; i < len; i++) {
+            if (!PM_PAGEMAP_PRESENT(pagemap[i]) || PM_PAGEMAP_SWAPPED(pagemap[i]))
+                continue;
+
+            pfn = PM_PAGEMAP_PFN(pagemap[i]);
+            if (pm_kernel_idle(map->proc->ker, pfn))
+                continue;
+
+            error = pm_kernel_count(map->proc->ker, pfn, &count);
+            if (error) return error;
+
+            ws.vss += map->proc->ker->pagesize;
+            ws.rss += (count >= 1) ? (map->proc->ker->pagesize) : (0);
+            ws.pss += (count >= 1) ? (map->proc->ker->pagesize / count) : (0);
+            ws.uss += (count == 1) ? (map->proc->ker->pagesize) : (0);
+        }
+    }
+
+    memcpy(ws_out, &ws, sizeof(ws));
 
     return 0;
 }
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2017 The Lep Open Source Project
+ *
+ */
+
+#include <stdlib.h>
+
+#include "pagemap.h"
+#include "workpool.h"
+
+struct parallel_ctx {
+    pm_parallel_fn fn;
+    void *arg;
+};
+
+static void parallel_worker(struct workpool *wp, int w) {
+    struct parallel_ctx *ctx = wp->arg;
+    uint64_t *buf;
+    size_t buf_len = PM_PAGEMAP_CHUNK;
+    size_t i, end;
+
+    (void)w;
+
+    /* Without a worker buffer every process simply allocates its own. */
+    buf = malloc(buf_len * sizeof(uint64_t));
+    if (!buf)
+        buf_len = 0;
+
+    while (workpool_next(wp, &i, &end))
+        for (; i < end; i++)
+            ctx->fn(ctx->arg, i, buf, buf_len);
+
+    free(buf);
+}
+
+void pm_parallel_for(size_t n, pm_parallel_fn fn, void *arg) {
+    struct parallel_ctx ctx;
+    struct workpool wp;
+
+    ctx.fn = fn;
+    ctx.arg = arg;
+
+    /* One process at a time: their sizes vary too much for bigger chunks. */
+    wp.n = n;
+    wp.chunk = 1;
+    wp.worker = parallel_worker;
+    wp.arg = &ctx;
+    workpool_run(&wp, workpool_size(n, PM_MAX_WORKERS, 1));
+}
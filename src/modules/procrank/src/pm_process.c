@@ -100,13 +100,74 @@ int pm_process_usage(pm_process_t *proc, pm_memusage_t *usage_out) {
     return pm_process_usage_flags(proc, usage_out, 0, 0);
 }
 
+void pm_process_set_pagemap_buf(pm_process_t *proc, uint64_t *buf, size_t len) {
+    if (!proc)
+        return;
+
+    if (proc->pagemap_buf_owned)
+        free(proc->pagemap_buf);
+
+    proc->pagemap_buf = buf;
+    proc->pagemap_buf_len = buf ? len : 0;
+    proc->pagemap_buf_owned = 0;
+}
+
+int pm_process_scratch(pm_process_t *proc, uint64_t **buf_out, size_t *len) {
+    if (!proc || !buf_out || !len)
+        return -1;
+
+    if (!proc->pagemap_buf) {
+        proc->pagemap_buf = malloc(PM_PAGEMAP_CHUNK * sizeof(uint64_t));
+        if (!proc->pagemap_buf)
+            return errno;
+        proc->pagemap_buf_len = PM_PAGEMAP_CHUNK;
+        proc->pagemap_buf_owned = 1;
+    }
+
+    *buf_out = proc->pagemap_buf;
+    *len = proc->pagemap_buf_len;
+
+    return 0;
+}
+
+int pm_process_pagemap_range_buf(pm_process_t *proc,
+                                 uint64_t low, uint64_t high,
+                                 uint64_t *range, size_t *len) {
+    uint64_t firstpage;
+    uint64_t numpages;
+    ssize_t ret;
+
+    if (!proc || (low > high) || !len)
+        return -1;
+
+    if (low == high) {
+        *len = 0;
+        return 0;
+    }
+
+    firstpage = low / proc->ker->pagesize;
+    numpages = (high - low) / proc->ker->pagesize;
+
+    ret = pread(proc->pagemap_fd, (char*)range, numpages * sizeof(uint64_t),
+                firstpage * sizeof(uint64_t));
+    if (ret == 0) {
+        /* EOF, mapping is not in userspace mapping range (probably vectors) */
+        *len = 0;
+        return 0;
+    } else if (ret < 0 || ret < (ssize_t)(numpages * sizeof(uint64_t))) {
+        return (ret < 0) ? errno : -1;
+    }
+
+    *len = numpages;
+
+    return 0;
+}
+
 int pm_process_pagemap_range(pm_process_t *proc,
                              uint64_t low, uint64_t high,
                              uint64_t **range_out, size_t *len) {
-    uint64_t firstpage;
     uint64_t numpages;
     uint64_t *range;
-    off64_t off;
     int error;
 
     if (!proc || (low > high) || !range_out || !len)
@@ -118,34 +179,20 @@ int pm_process_pagemap_range(pm_process_t *proc,
         return 0;
     }
 
-    firstpage = low / proc->ker->pagesize;
     numpages = (high - low) / proc->ker->pagesize;
 
     range = malloc(numpages * sizeof(uint64_t));
     if (!range)
         return errno;
 
-    off = lseek64(proc->pagemap_fd, firstpage * sizeof(uint64_t), SEEK_SET);
-    if (off == (off_t)-1) {
-        error = errno;
-        free(range);
-        return error;
-    }
-    error = read(proc->pagemap_fd, (char*)range, numpages * sizeof(uint64_t));
-    if (error == 0) {
-        /* EOF, mapping is not in userspace mapping range (probably vectors) */
-        *len = 0;
+    error = pm_process_pagemap_range_buf(proc, low, high, range, len);
+    if (error || *len == 0) {
         free(range);
         *range_out = NULL;
-        return 0;
-    } else if (error < 0 || (error > 0 && error < (int)(numpages * sizeof(uint64_t)))) {
-        error = (error < 0) ? errno : -1;
-        free(range);
         return error;
     }
 
     *range_out = range;
-    *len = numpages;
 
     return 0;
 }
@@ -214,6 +261,27 @@ int pm_process_workingset(pm_process_t *proc,
     return 0;
 }
 
+int pm_process_idle_workingset(pm_process_t *proc, pm_memusage_t *ws_out) {
+    pm_memusage_t ws, map_ws;
+    int error;
+    int i;
+
+    if (!proc || !ws_out)
+        return -1;
+
+    pm_memusage_zero(&ws);
+    for (i = 0; i < proc->num_maps; i++) {
+        error = pm_map_idle_workingset(proc->maps[i], &map_ws);
+        if (error) return error;
+
+        pm_memusage_add(&ws, &map_ws);
+    }
+
+    memcpy(ws_out, &ws, sizeof(ws));
+
+    return 0;
+}
+
 int pm_process_destroy(pm_process_t *proc) {
     int i;
 
@@ -225,6 +293,8 @@ int pm_process_destroy(pm_process_t *proc) {
     }
     free(proc->maps);
     close(proc->pagemap_fd);
+    if (proc->pagemap_buf_owned)
+        free(proc->pagemap_buf);
     free(proc);
 
     return 0;
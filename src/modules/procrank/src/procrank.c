@@ -22,15 +22,31 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include <signal.h>
 
 #include "pagemap.h"
 
+/* What a process looked like when its usage was last walked in full.  Kept
+ * across procrank_main() calls so unchanged processes can be skipped. */
+struct proc_state {
+    pid_t pid;
+    unsigned long long starttime;
+    unsigned long vss_pages;
+    unsigned long rss_pages;
+    uint64_t flags_mask;
+    uint64_t required_flags;
+    time_t walked;
+    pm_memusage_t usage;
+};
+
 struct proc_info {
     pid_t pid;
     pm_memusage_t usage;
     uint64_t wss;
+    struct proc_state state;
+    bool has_state;
 };
 
 static void usage(char *myname);
@@ -119,10 +135,319 @@ void print_mem_info(FILE *fp) {
             mem[0], mem[1], mem[2], mem[3], mem[4], mem[5]);
 }
 
+#define WS_OFF   0
+#define WS_ONLY  1
+#define WS_RESET 2
+#define WS_IDLE  3
+
+/*
+ * Working sets from the page_idle bitmap cover the time since the previous
+ * -I run, which marked all pages idle on its way out.  Without a recent
+ * enough mark (first run, or more than IDLE_MAX_AGE seconds ago) we mark and
+ * wait IDLE_INTERVAL_MS instead.
+ */
+#define IDLE_INTERVAL_MS 1000
+#define IDLE_MAX_AGE     60
+
+static struct timespec idle_marked;
+
+static long elapsed_ms(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) * 1000 +
+           (to->tv_nsec - from->tv_nsec) / 1000000;
+}
+
+/* Read which pages were touched since the last mark, and mark again for the
+ * next run.  The covered interval is returned through *interval_ms. */
+static int sample_idle_pages(pm_kernel_t *ker, long *interval_ms) {
+    struct timespec now;
+    int error;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!idle_marked.tv_sec ||
+        elapsed_ms(&idle_marked, &now) > IDLE_MAX_AGE * 1000) {
+        error = pm_kernel_idle_mark(ker);
+        if (error)
+            return error;
+        clock_gettime(CLOCK_MONOTONIC, &idle_marked);
+        usleep(IDLE_INTERVAL_MS * 1000);
+    }
+
+    error = pm_kernel_idle_read(ker);
+    if (error)
+        return error;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    *interval_ms = elapsed_ms(&idle_marked, &now);
+
+    /* Pagemap walks do not touch the pages, so marking now rather than
+     * after collection loses nothing. */
+    error = pm_kernel_idle_mark(ker);
+    if (error) {
+        idle_marked.tv_sec = 0;
+        return error;
+    }
+    idle_marked = now;
+
+    return 0;
+}
+
+/* Shared by the collector threads, which fill in procs[i] for the PIDs
+ * handed to them by pm_parallel_for(). */
+struct collect_ctx {
+    pm_kernel_t *ker;
+    pid_t *pids;
+    struct proc_info **procs;
+    size_t num_procs;
+    int ws;
+    uint64_t flags_mask;
+    uint64_t required_flags;
+    bool incremental;
+    bool rollup;
+    time_t now;
+};
+
+/*
+ * A process whose start time and virtual size are unchanged, and whose
+ * resident size moved by less than 1/2^RSS_SLACK_SHIFT (or RSS_SLACK_PAGES),
+ * reuses the usage of its last full walk.  Every STATE_MAX_AGE seconds it is
+ * walked again anyway, since its PSS also depends on who else maps its pages.
+ */
+#define RSS_SLACK_SHIFT 5
+#define RSS_SLACK_PAGES 16
+#define STATE_MAX_AGE   30
+
+/* Sorted by PID; only read while the collector threads run. */
+static struct proc_state *prev_states;
+static size_t num_prev_states;
+
+static int statecmp(const void *a, const void *b) {
+    pid_t pa = ((const struct proc_state *)a)->pid;
+    pid_t pb = ((const struct proc_state *)b)->pid;
+
+    return (pa > pb) - (pa < pb);
+}
+
+static struct proc_state *find_prev_state(pid_t pid) {
+    struct proc_state key;
+
+    if (!prev_states)
+        return NULL;
+
+    key.pid = pid;
+    return bsearch(&key, prev_states, num_prev_states, sizeof(key), statecmp);
+}
+
+static int read_small_file(const char *filename, char *buf, size_t len) {
+    ssize_t ret;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    ret = read(fd, buf, len - 1);
+    close(fd);
+    if (ret <= 0)
+        return -1;
+    buf[ret] = '\0';
+
+    return 0;
+}
+
+/* Fill the start time and statm sizes of pid into *st: two small reads that
+ * are much cheaper than walking the maps and the pagemap. */
+static int read_footprint(pid_t pid, struct proc_state *st) {
+    char filename[64], buf[1024];
+    char *p;
+    int field;
+
+    snprintf(filename, sizeof(filename), "/proc/%d/stat", pid);
+    if (read_small_file(filename, buf, sizeof(buf)))
+        return -1;
+
+    /* comm may contain spaces; fields are counted from the last ')'. */
+    p = strrchr(buf, ')');
+    if (!p)
+        return -1;
+    for (field = 2; field < 22 && p; field++)
+        p = strchr(p + 1, ' ');
+    if (!p)
+        return -1;
+    st->starttime = strtoull(p + 1, NULL, 10);
+
+    snprintf(filename, sizeof(filename), "/proc/%d/statm", pid);
+    if (read_small_file(filename, buf, sizeof(buf)))
+        return -1;
+    if (sscanf(buf, "%lu %lu", &st->vss_pages, &st->rss_pages) != 2)
+        return -1;
+
+    st->pid = pid;
+
+    return 0;
+}
+
+static bool footprint_unchanged(struct collect_ctx *ctx,
+                                const struct proc_state *prev,
+                                const struct proc_state *cur) {
+    unsigned long slack, diff;
+
+    if (prev->starttime != cur->starttime ||
+        prev->vss_pages != cur->vss_pages ||
+        prev->flags_mask != ctx->flags_mask ||
+        prev->required_flags != ctx->required_flags ||
+        ctx->now - prev->walked >= STATE_MAX_AGE)
+        return false;
+
+    slack = prev->rss_pages >> RSS_SLACK_SHIFT;
+    if (slack < RSS_SLACK_PAGES)
+        slack = RSS_SLACK_PAGES;
+    diff = (cur->rss_pages > prev->rss_pages) ?
+           cur->rss_pages - prev->rss_pages : prev->rss_pages - cur->rss_pages;
+
+    return diff <= slack;
+}
+
+/*
+ * Fill *usage from /proc/PID/smaps_rollup (Linux 4.14+), which the kernel
+ * sums up for us without needing /proc/kpagecount.  USS is the private part
+ * of the resident set; VSS is not in the rollup, so it comes from statm.
+ */
+static int read_rollup_usage(pid_t pid, unsigned long vss_pages,
+                             pm_memusage_t *usage) {
+    static const struct {
+        const char *key;
+        size_t len;
+    } keys[] = {
+        { "Rss:", 4 },
+        { "Pss:", 4 },
+        { "Swap:", 5 },
+        { "Private_Clean:", 14 },
+        { "Private_Dirty:", 14 },
+    };
+    size_t val[5] = { 0, 0, 0, 0, 0 };
+    char filename[64], buf[4096];
+    char *p;
+    size_t k;
+    int found = 0;
+
+    snprintf(filename, sizeof(filename), "/proc/%d/smaps_rollup", pid);
+    if (read_small_file(filename, buf, sizeof(buf)))
+        return -1;
+
+    /* The first line is the [rollup] pseudo-mapping header. */
+    for (p = strchr(buf, '\n'); p && *++p; p = strchr(p, '\n')) {
+        for (k = 0; k < 5; k++) {
+            if (!strncmp(p, keys[k].key, keys[k].len)) {
+                val[k] = strtoull(p + keys[k].len, NULL, 10) * 1024;
+                found++;
+                break;
+            }
+        }
+    }
+    if (!found)
+        return -1;
+
+    usage->vss = vss_pages * getpagesize();
+    usage->rss = val[0];
+    usage->pss = val[1];
+    usage->swap = val[2];
+    usage->uss = val[3] + val[4];
+
+    return 0;
+}
+
+/* Replace the saved states with those collected in this run. */
+static void save_states(struct proc_info **procs, size_t num_procs) {
+    struct proc_state *states;
+    size_t i, n;
+
+    free(prev_states);
+    prev_states = NULL;
+    num_prev_states = 0;
+
+    states = malloc(num_procs * sizeof(*states));
+    if (!states)
+        return;
+
+    for (i = n = 0; i < num_procs; i++) {
+        if (procs[i]->has_state)
+            states[n++] = procs[i]->state;
+    }
+    qsort(states, n, sizeof(*states), statecmp);
+
+    prev_states = states;
+    num_prev_states = n;
+}
+
+static void collect_one(void *arg, size_t i, uint64_t *buf, size_t buf_len) {
+    struct collect_ctx *ctx = arg;
+    struct proc_info *info = ctx->procs[i];
+    struct proc_state *prev;
+    pm_process_t *proc;
+    bool has_footprint = false;
+    int error;
+
+    /* Only plain usage is remembered; working sets are always walked. */
+    if (ctx->ws == WS_OFF) {
+        has_footprint = !read_footprint(ctx->pids[i], &info->state);
+        if (ctx->rollup && has_footprint &&
+            !read_rollup_usage(ctx->pids[i], info->state.vss_pages, &info->usage))
+            return;
+        prev = has_footprint && ctx->incremental ?
+               find_prev_state(ctx->pids[i]) : NULL;
+        if (prev && footprint_unchanged(ctx, prev, &info->state)) {
+            info->usage = prev->usage;
+            info->state = *prev;
+            info->has_state = true;
+            return;
+        }
+    }
+
+    /* In rollup mode the pagemap interface is only a fallback, and may be
+     * missing when we lack the privileges for /proc/kpagecount. */
+    if (!ctx->ker) {
+        fprintf(stderr, "warning: could not read usage for %d\n", ctx->pids[i]);
+        return;
+    }
+
+    error = pm_process_create(ctx->ker, ctx->pids[i], &proc);
+    if (error) {
+        fprintf(stderr, "warning: could not create process interface for %d\n", ctx->pids[i]);
+        return;
+    }
+    pm_process_set_pagemap_buf(proc, buf, buf_len);
+
+    switch (ctx->ws) {
+    case WS_OFF:
+        error = pm_process_usage_flags(proc, &ctx->procs[i]->usage,
+                                       ctx->flags_mask, ctx->required_flags);
+        break;
+    case WS_ONLY:
+        error = pm_process_workingset(proc, &ctx->procs[i]->usage, 0);
+        break;
+    case WS_RESET:
+        error = pm_process_workingset(proc, NULL, 1);
+        break;
+    case WS_IDLE:
+        error = pm_process_idle_workingset(proc, &ctx->procs[i]->usage);
+        break;
+    }
+
+    if (error) {
+        fprintf(stderr, "warning: could not read usage for %d\n", ctx->pids[i]);
+    } else if (has_footprint) {
+        info->state.flags_mask = ctx->flags_mask;
+        info->state.required_flags = ctx->required_flags;
+        info->state.walked = ctx->now;
+        info->state.usage = info->usage;
+        info->has_state = true;
+    }
+
+    pm_process_destroy(proc);
+}
+
 #define MAX_LINES 50
 int procrank_main(int argc, char *argv[], int out_fd) {
     pm_kernel_t *ker;
-    pm_process_t *proc;
+    struct collect_ctx ctx;
     pid_t *pids;
     struct proc_info **procs;
     size_t num_procs;
@@ -132,15 +457,15 @@ int procrank_main(int argc, char *argv[], int out_fd) {
     char cmdline[256]; // this must be within the range of int
     int error;
     bool has_swap = false;
+    bool incremental = true;
+    bool rollup = false;
+    long idle_interval = 0;
     uint64_t required_flags = 0;
     uint64_t flags_mask = 0;
 
     FILE *fp = fdopen(out_fd, "w");
     if(fp == NULL) return EXIT_SUCCESS;
 
-    #define WS_OFF   0
-    #define WS_ONLY  1
-    #define WS_RESET 2
     int ws;
 
     int arg;
@@ -161,7 +486,10 @@ int procrank_main(int argc, char *argv[], int out_fd) {
         if (!strcmp(argv[arg], "-k")) { required_flags = flags_mask = PM_PAGE_KSM; continue; }
         if (!strcmp(argv[arg], "-w")) { ws = WS_ONLY; continue; }
         if (!strcmp(argv[arg], "-W")) { ws = WS_RESET; continue; }
+        if (!strcmp(argv[arg], "-I")) { ws = WS_IDLE; continue; }
         if (!strcmp(argv[arg], "-R")) { order *= -1; continue; }
+        if (!strcmp(argv[arg], "-f")) { incremental = false; continue; }
+        if (!strcmp(argv[arg], "-S")) { rollup = true; continue; }
         if (!strcmp(argv[arg], "-h")) { usage(argv[0]); exit(0); }
         fprintf(stderr, "Invalid argument \"%s\".\n", argv[arg]);
         usage(argv[0]);
@@ -169,14 +497,32 @@ int procrank_main(int argc, char *argv[], int out_fd) {
         return EXIT_FAILURE;
     }
 
+    /* The rollup only knows plain usage; filters and working sets need the
+     * pagemap. */
+    if (ws != WS_OFF || flags_mask)
+        rollup = false;
+
     error = pm_kernel_create(&ker);
-    if (error) {
+    if (error && rollup) {
+        ker = NULL;
+    } else if (error) {
         fprintf(stderr, "Error creating kernel interface -- "
                         "does this kernel have pagemap?\n");
         //exit(EXIT_FAILURE);
 	return EXIT_FAILURE;
     }
 
+    if (ws == WS_IDLE) {
+        error = sample_idle_pages(ker, &idle_interval);
+        if (error) {
+            fprintf(stderr, "Error using /sys/kernel/mm/page_idle -- "
+                            "does this kernel have CONFIG_IDLE_PAGE_TRACKING?\n");
+            pm_kernel_destroy(ker);
+            fclose(fp);
+            return EXIT_FAILURE;
+        }
+    }
+
     error = pm_kernel_pids(ker, &pids, &num_procs);
     if (error) {
         fprintf(stderr, "Error listing processes.\n");
@@ -200,34 +546,32 @@ int procrank_main(int argc, char *argv[], int out_fd) {
         }
         procs[i]->pid = pids[i];
         pm_memusage_zero(&procs[i]->usage);
-        error = pm_process_create(ker, pids[i], &proc);
-        if (error) {
-            fprintf(stderr, "warning: could not create process interface for %d\n", pids[i]);
-            continue;
-        }
-
-        switch (ws) {
-        case WS_OFF:
-            error = pm_process_usage_flags(proc, &procs[i]->usage, flags_mask,
-                                           required_flags);
-            break;
-        case WS_ONLY:
-            error = pm_process_workingset(proc, &procs[i]->usage, 0);
-            break;
-        case WS_RESET:
-            error = pm_process_workingset(proc, NULL, 1);
-            break;
-        }
+        procs[i]->has_state = false;
+    }
 
-        if (error) {
-            fprintf(stderr, "warning: could not read usage for %d\n", pids[i]);
-        }
+    ctx.ker = ker;
+    ctx.pids = pids;
+    ctx.procs = procs;
+    ctx.num_procs = num_procs;
+    ctx.ws = ws;
+    ctx.flags_mask = flags_mask;
+    ctx.required_flags = required_flags;
+    ctx.incremental = incremental;
+    ctx.rollup = rollup;
+    ctx.now = time(NULL);
+    /* Results land in procs[] in PID-list order, so the output does not
+     * depend on how the work was split between threads. */
+    pm_parallel_for(num_procs, collect_one, &ctx);
+
+    /* Rollup figures are not comparable with walked ones; leave the saved
+     * states for the next pagemap run. */
+    if (ws == WS_OFF && !rollup)
+        save_states(procs, num_procs);
 
+    for (i = 0; i < num_procs; i++) {
         if (ws != WS_RESET && procs[i]->usage.swap) {
             has_swap = true;
         }
-
-        pm_process_destroy(proc);
     }
 
     free(pids);
@@ -347,6 +691,11 @@ int procrank_main(int argc, char *argv[], int out_fd) {
 
     fprintf(fp,"TOTAL\n");
 
+    if (ws == WS_IDLE) {
+        fprintf(fp, "\nWorking set: pages accessed in the last %ld ms\n",
+                idle_interval);
+    }
+
     fprintf(fp,"\n");
     print_mem_info(fp);
     fclose(fp);
@@ -356,7 +705,7 @@ int procrank_main(int argc, char *argv[], int out_fd) {
 }
 
 static void usage(char *myname) {
-    fprintf(stderr, "Usage: %s [ -W ] [ -v | -r | -p | -u | -s | -h ]\n"
+    fprintf(stderr, "Usage: %s [ -W | -I ] [ -f | -S ] [ -v | -r | -p | -u | -s | -h ]\n"
                     "    -v  Sort by VSS.\n"
                     "    -r  Sort by RSS.\n"
                     "    -p  Sort by PSS.\n"
@@ -369,6 +718,10 @@ static void usage(char *myname) {
                     "    -k  Only show pages collapsed by KSM\n"
                     "    -w  Display statistics for working set only.\n"
                     "    -W  Reset working set of all processes.\n"
+                    "    -I  Display working set since the last -I run, from the\n"
+                    "        page_idle bitmap (without resetting any process).\n"
+                    "    -f  Walk every process, even if unchanged since the last run.\n"
+                    "    -S  Use /proc/PID/smaps_rollup where available (fast, no root).\n"
                     "    -h  Display this help screen.\n",
     myname);
 }
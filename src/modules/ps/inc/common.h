@@ -94,8 +94,6 @@
 #define CF_PRINT_AS_NEEDED    0x80000000 // means we have no clue, so assume EVERY TIME
 #define CF_PRINT_MASK         0xf0000000
 
-#define needs_for_select (PROC_FILLSTAT | PROC_FILLSTATUS)
-
 /* thread_flags */
 #define TF_B_H         0x0001
 #define TF_B_m         0x0002
@@ -310,6 +308,7 @@ extern const char     *sysv_fl_format;
 extern const char     *sysv_j_format;
 extern const char     *sysv_l_format;
 extern unsigned        thread_flags;
+extern int             top_rows;
 extern int             unix_f_option;
 extern int             user_is_number;
 extern int             wchan_is_number;
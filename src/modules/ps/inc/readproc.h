@@ -113,9 +113,9 @@ typedef struct proc_t {
 	drs,		// statm           data+stack resident set (as # pages)
 	dt;		// statm           dirty pages (always 0 w/ 2.6)
     unsigned long
-	vm_size,        // status          equals 'size' (as kb)
+	vm_size,        // status/stat     equals 'size' (as kb)
 	vm_lock,        // status          locked pages (as kb)
-	vm_rss,         // status          equals 'rss' and/or 'resident' (as kb)
+	vm_rss,         // status/stat     equals 'rss' and/or 'resident' (as kb)
 	vm_rss_anon,    // status          the 'anonymous' portion of vm_rss (as kb)
 	vm_rss_file,    // status          the 'file-backed' portion of vm_rss (as kb)
 	vm_rss_shared,  // status          the 'shared' portion of vm_rss (as kb)
@@ -132,7 +132,11 @@ typedef struct proc_t {
 	min_flt,	// stat            number of minor page faults since process start
 	maj_flt,	// stat            number of major page faults since process start
 	cmin_flt,	// stat            cumulative min_flt of process and child processes
-	cmaj_flt;	// stat            cumulative maj_flt of process and child processes
+	cmaj_flt,	// stat            cumulative maj_flt of process and child processes
+	nvcsw,		// status          voluntary context switches
+	nivcsw,		// status          involuntary context switches
+	vcsw_rate,	// status (special) nvcsw per second since last update
+	ivcsw_rate;	// status (special) nivcsw per second since last update
     char
         **environ,      // (special)       environment string vector (/proc/#/environ)
         **cmdline,      // (special)       command line string vector (/proc/#/cmdline)
@@ -195,6 +199,12 @@ typedef struct proc_t {
 
 #define PROCPATHLEN 64  // must hold /proc/2000222000/task/2000222000/cmdline
 
+// dynamic 'utility' buffer support for file2str() calls
+struct utlbuf_s {
+    char *buf;     // dynamically grown buffer
+    int   siz;     // current len of the above
+};
+
 typedef struct PROCTAB {
     DIR*	procfs;
 //    char deBug0[64];
@@ -215,6 +225,7 @@ typedef struct PROCTAB {
     void *      vp; // generic
     char        path[PROCPATHLEN];  // must hold /proc/2000222000/task/2000222000/cmdline
     unsigned pathlen;        // length of string in the above (w/o '\0')
+    struct utlbuf_s ub;      // stat,statm,status buffer of this scan
 } PROCTAB;
 
 // Initialize a PROCTAB structure holding needed call-to-call persistent data
@@ -286,21 +286,38 @@ static int link_name(char *restrict const buf, unsigned maj, unsigned min, int p
 }
 
 /* number --> name */
+/* A device number always has the same name, so remember the ones found
+ * rather than stat()ing /dev and /proc/#/fd again for every process that
+ * sits on that tty.  Direct mapped on dev; 0 marks a free slot. */
+#define TTY_CACHE_SIZE 64
+static struct tty_cache_ent {
+  unsigned dev;
+  char name[TTY_NAME_SIZE];
+} tty_cache[TTY_CACHE_SIZE];
+
 unsigned dev_to_tty(char *restrict ret, unsigned chop, dev_t dev_t_dev, int pid, unsigned int flags) {
   static char buf[TTY_NAME_SIZE];
   char *restrict tmp = buf;
   unsigned dev = dev_t_dev;
   unsigned i = 0;
   int c;
+  struct tty_cache_ent *ent = &tty_cache[(dev * 2654435761u) >> 26];
   if(dev == 0u) goto no_tty;
-  if(driver_name(tmp, MAJOR_OF(dev), MINOR_OF(dev)               )) goto abbrev;
-  if(  link_name(tmp, MAJOR_OF(dev), MINOR_OF(dev), pid, "fd/2"  )) goto abbrev;
-  if( guess_name(tmp, MAJOR_OF(dev), MINOR_OF(dev)               )) goto abbrev;
-  if(  link_name(tmp, MAJOR_OF(dev), MINOR_OF(dev), pid, "fd/255")) goto abbrev;
+  if(ent->dev == dev){
+    memcpy(tmp, ent->name, sizeof buf);
+    goto abbrev;
+  }
+  if(driver_name(tmp, MAJOR_OF(dev), MINOR_OF(dev)               )) goto found;
+  if(  link_name(tmp, MAJOR_OF(dev), MINOR_OF(dev), pid, "fd/2"  )) goto found;
+  if( guess_name(tmp, MAJOR_OF(dev), MINOR_OF(dev)               )) goto found;
+  if(  link_name(tmp, MAJOR_OF(dev), MINOR_OF(dev), pid, "fd/255")) goto found;
   // fall through if unable to find a device file
 no_tty:
   strcpy(ret, "?");
   return 1;
+found:
+  ent->dev = dev;
+  memcpy(ent->name, tmp, sizeof buf);
 abbrev:
   if((flags&ABBREV_DEV) && !strncmp(tmp,"/dev/",5) && tmp[5]) tmp += 5;
   if((flags&ABBREV_TTY) && !strncmp(tmp,"tty",  3) && tmp[3]) tmp += 3;
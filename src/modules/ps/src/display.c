@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/sysmacros.h>
@@ -217,6 +218,22 @@ static unsigned check_sort_needs(sort_node *walk){
   return needs;
 }
 
+/***** check select needs */
+/* stat is always read; status only for the real/saved/fs id selections */
+static unsigned check_select_needs(selection_node *walk){
+  unsigned needs = PROC_FILLSTAT;
+  while(walk){
+    switch(walk->typecode){
+    case SEL_RUID: case SEL_SUID: case SEL_FUID:
+    case SEL_RGID: case SEL_SGID: case SEL_FGID:
+      needs |= PROC_FILLSTATUS;
+      break;
+    }
+    walk = walk->next;
+  }
+  return needs;
+}
+
 /***** check needs */
 /* see what files need to be read, etc. */
 static unsigned collect_format_needs(format_node *walk){
@@ -233,6 +250,7 @@ static format_node *task_format_list;
 
 static unsigned needs_for_threads;
 static unsigned needs_for_sort;
+static unsigned needs_for_select;
 static unsigned proc_format_needs;
 static unsigned task_format_needs;
 
@@ -288,6 +306,7 @@ static void lists_and_needs(void){
   task_format_needs = collect_format_needs(task_format_list);
 
   needs_for_sort = check_sort_needs(sort_list);
+  needs_for_select = check_select_needs(selection_list);
 
   // move process-only flags to the process
   proc_format_needs |= (task_format_needs &~ PROC_ONLY_FLAGS);
@@ -315,26 +334,158 @@ static void lists_and_needs(void){
 
 //////////////////////////////////////////////////////////////////////////
 
-/***** fill in %CPU; not in libproc because of include_dead_children */
-/* Note: for sorting, not display, so 0..0x7fffffff would be OK */
-static int want_this_proc_pcpu(proc_t *buf){
-  unsigned long long used_jiffies;
-  unsigned long pcpu = 0;
-  unsigned long long seconds;
+/***** recent %CPU and context switch rates */
+/*
+ * ps_main() runs many times inside one lepd process, so the CPU time and
+ * context switch counts each task had at the previous run are kept in a
+ * tid-keyed table and %CPU, vcsw and ivcsw are rates over that interval.
+ * Tasks missing from it (first run, new or recycled pids, a run too soon
+ * after the last one) fall back to the classic lifetime average.  Processes
+ * and threads key separately because a thread-group leader shares its pid
+ * with the main thread.
+ */
+#define PCPU_MIN_MSEC 250      // shorter intervals are mostly jiffy noise
+
+typedef struct pcpu_sample {
+  unsigned key;                  // tid*2 + is_task, 0 = free slot
+  unsigned long long start_time; // tells a recycled pid apart
+  unsigned long long used;       // utime + stime
+  unsigned long long cused;      // cutime + cstime
+  unsigned long nvcsw;           // voluntary context switches
+  unsigned long nivcsw;          // involuntary context switches
+} pcpu_sample;
+
+typedef struct pcpu_table {
+  pcpu_sample *slot;
+  unsigned size;                 // power of 2
+  unsigned n;
+  struct timespec when;
+} pcpu_table;
+
+/* process and thread listings (GetCmdTop, GetCmdTopH) alternate in lepd,
+ * so each view keeps its own pair of tables */
+static pcpu_table pcpu_tabs[2][2];
+static int pcpu_flip[2];
+static int pcpu_view;                  // 1 if threads are listed
+static pcpu_table *pcpu_prev, *pcpu_cur;
+static unsigned long long pcpu_msec;   // since pcpu_prev, 0 = don't use it
+static int pcpu_tasks;                 // fancy_spew reads threads
+static int pcpu_full;                  // every task is listed
+
+static unsigned pcpu_hash(unsigned key){
+  return key * 2654435761u;
+}
 
-  if(!want_this_proc(buf)) return 0;
+static pcpu_sample *pcpu_find(const pcpu_table *tab, unsigned key){
+  unsigned i;
+  if(!tab->n) return NULL;
+  for(i = pcpu_hash(key) & (tab->size-1); tab->slot[i].key; i = (i+1) & (tab->size-1))
+    if(tab->slot[i].key == key) return &tab->slot[i];
+  return NULL;
+}
 
-  used_jiffies = buf->utime + buf->stime;
-  if(include_dead_children) used_jiffies += (buf->cutime + buf->cstime);
+static void pcpu_record(const proc_t *p, int task){
+  pcpu_table *tab = pcpu_cur;
+  pcpu_sample *s;
+  unsigned key = p->tid * 2 + !!task;
+  unsigned i;
+
+  if(tab->n * 2 >= tab->size){         // keep the load under 1/2
+    pcpu_table old = *tab;
+    tab->size = old.size ? old.size * 2 : 256;
+    tab->slot = xcalloc(tab->size * sizeof(pcpu_sample));
+    tab->n = 0;
+    for(i = 0; i < old.size; i++){
+      if(!old.slot[i].key) continue;
+      s = &tab->slot[pcpu_hash(old.slot[i].key) & (tab->size-1)];
+      while(s->key) s = (s == &tab->slot[tab->size-1]) ? tab->slot : s+1;
+      *s = old.slot[i];
+      tab->n++;
+    }
+    free(old.slot);
+  }
+  for(i = pcpu_hash(key) & (tab->size-1); tab->slot[i].key; i = (i+1) & (tab->size-1))
+    if(tab->slot[i].key == key) break;
+  s = &tab->slot[i];
+  if(!s->key) tab->n++;
+  s->key = key;
+  s->start_time = p->start_time;
+  s->used = p->utime + p->stime;
+  s->cused = p->cutime + p->cstime;
+  s->nvcsw = p->nvcsw;
+  s->nivcsw = p->nivcsw;
+}
 
-  seconds = seconds_since_boot - buf->start_time / Hertz;
-  if(seconds) pcpu = (used_jiffies * 1000ULL / Hertz) / seconds;
+/* start a run: see whether the previous sample is usable, empty the new one */
+static void pcpu_begin(void){
+  pcpu_view = !!(thread_flags & (TF_show_task|TF_loose_tasks));
+  pcpu_full = all_processes && !running_only && !negate_selection;
+  pcpu_prev = &pcpu_tabs[pcpu_view][pcpu_flip[pcpu_view]];
+  pcpu_cur = &pcpu_tabs[pcpu_view][!pcpu_flip[pcpu_view]];
+  clock_gettime(CLOCK_MONOTONIC, &pcpu_cur->when);
+  pcpu_msec = 0;
+  if(pcpu_prev->n){
+    pcpu_msec = (pcpu_cur->when.tv_sec - pcpu_prev->when.tv_sec) * 1000ULL
+              + pcpu_cur->when.tv_nsec / 1000000 - pcpu_prev->when.tv_nsec / 1000000;
+    if(pcpu_msec < PCPU_MIN_MSEC) pcpu_msec = 0;
+  }
+  if(pcpu_cur->n) memset(pcpu_cur->slot, 0, pcpu_cur->size * sizeof(pcpu_sample));
+  pcpu_cur->n = 0;
+}
+
+/* end a run: the new sample becomes the baseline, unless it came too soon
+ * or only covers some tasks (a "ps -p" must not reset GetCmdTop's rates) */
+static void pcpu_end(void){
+  if(!pcpu_full) return;
+  if(pcpu_prev->n && !pcpu_msec) return;
+  pcpu_flip[pcpu_view] ^= 1;
+}
+
+/* per-mill %CPU (fits in an int, summing children on 128 CPUs) and
+ * context switches per second */
+static void pcpu_fill(proc_t *p, int task){
+  unsigned long long used_jiffies;
+  unsigned long long seconds;
+  const pcpu_sample *s;
+
+  used_jiffies = p->utime + p->stime;
+  if(include_dead_children) used_jiffies += (p->cutime + p->cstime);
+
+  if(pcpu_msec && (s = pcpu_find(pcpu_prev, p->tid * 2 + !!task))
+     && s->start_time == p->start_time){
+    used_jiffies -= s->used;
+    if(include_dead_children) used_jiffies -= s->cused;
+    p->pcpu = (used_jiffies * 1000000ULL / Hertz) / pcpu_msec;
+    p->vcsw_rate = (p->nvcsw - s->nvcsw) * 1000ULL / pcpu_msec;
+    p->ivcsw_rate = (p->nivcsw - s->nivcsw) * 1000ULL / pcpu_msec;
+    return;
+  }
 
-  buf->pcpu = pcpu;  // fits in an int, summing children on 128 CPUs
+  seconds = seconds_since_boot - p->start_time / Hertz;
+  if(!seconds){
+    p->pcpu = p->vcsw_rate = p->ivcsw_rate = 0;
+    return;
+  }
+  p->pcpu = (used_jiffies * 1000ULL / Hertz) / seconds;
+  p->vcsw_rate = p->nvcsw / seconds;
+  p->ivcsw_rate = p->nivcsw / seconds;
+}
 
+/***** fill in %CPU; not in libproc because of include_dead_children */
+/* Note: for sorting, not display, so 0..0x7fffffff would be OK */
+/* May run on several readproctab scan threads: pcpu_prev is only read. */
+static int want_this_proc_pcpu(proc_t *buf){
+  if(!want_this_proc(buf)) return 0;
+  pcpu_fill(buf, pcpu_tasks);
   return 1;
 }
 
+/***** pcpu_fill() then pcpu_record() for one task shown by simple_spew */
+static void pcpu_fill_and_record(proc_t *buf, int task){
+  pcpu_fill(buf, task);
+  pcpu_record(buf, task);
+}
+
 /***** just display */
 static void simple_spew(FILE *out_fp){
   static proc_t buf, buf2;       // static avoids memset
@@ -342,6 +493,7 @@ static void simple_spew(FILE *out_fp){
   pid_t* pidlist;
   int flags;
   int i;
+  int left = top_rows ? top_rows : -1;  // --top without a sort: the first N
 
   pidlist = NULL;
   flags = needs_for_format | needs_for_sort | needs_for_select | needs_for_threads;
@@ -368,39 +520,53 @@ static void simple_spew(FILE *out_fp){
   }
   switch(thread_flags & (TF_show_proc|TF_loose_tasks|TF_show_task)){
   case TF_show_proc:                   // normal non-thread output
-    while(readproc(ptp,&buf)){
+    while(left && readproc(ptp,&buf)){
       if(want_this_proc(&buf)){
+        left--;
+        pcpu_fill_and_record(&buf, 0);
         show_one_proc(&buf, proc_format_list,out_fp);
       }
     }
     break;
   case TF_show_proc|TF_loose_tasks:    // H option
-    while(readproc(ptp,&buf)){
+    while(left && readproc(ptp,&buf)){
       // must still have the process allocated
-      while(readtask(ptp,&buf,&buf2)){
+      while(left && readtask(ptp,&buf,&buf2)){
         if(!want_this_proc(&buf)) continue;
+        left--;
+        pcpu_fill_and_record(&buf2, 1);
         show_one_proc(&buf2, task_format_list,out_fp);
       }
     }
     break;
   case TF_show_proc|TF_show_task:      // m and -m options
-    while(readproc(ptp,&buf)){
+    while(left && readproc(ptp,&buf)){
       if(want_this_proc(&buf)){
+        left--;
+        pcpu_fill_and_record(&buf, 0);
         show_one_proc(&buf, proc_format_list,out_fp);
         // must still have the process allocated
-        while(readtask(ptp,&buf,&buf2)) show_one_proc(&buf2, task_format_list,out_fp);
+        while(readtask(ptp,&buf,&buf2)){
+          pcpu_fill_and_record(&buf2, 1);
+          show_one_proc(&buf2, task_format_list,out_fp);
+        }
       }
      }
     break;
-  case TF_show_task:                   // -L and -T options
-    while(readproc(ptp,&buf)){
+  case TF_show_task:                   // -L and -T options: --top counts threads
+    while(left && readproc(ptp,&buf)){
       if(want_this_proc(&buf)){
         // must still have the process allocated
-        while(readtask(ptp,&buf,&buf2)) show_one_proc(&buf2, task_format_list,out_fp);
+        while(left && readtask(ptp,&buf,&buf2)){
+          left--;
+          pcpu_fill_and_record(&buf2, 1);
+          show_one_proc(&buf2, task_format_list,out_fp);
+        }
       }
    }
     break;
   }
+  if(!left) pcpu_full = 0;              // --top stopped the scan early
   closeproc(ptp);
   freeproc(NULL);
   if (pidlist) free(pidlist);
@@ -450,15 +616,55 @@ static int compare_two_procs(const void *a, const void *b){
   return 0; /* no conclusion */
 }
 
+/***** partial sort for --top */
+static void sift_down_procs(int i, int n){
+  for(;;){
+    int big = i, l = 2*i+1, r = l+1;
+    proc_t *tmp;
+    if(l < n && compare_two_procs(&processes[l], &processes[big]) > 0) big = l;
+    if(r < n && compare_two_procs(&processes[r], &processes[big]) > 0) big = r;
+    if(big == i) return;
+    tmp = processes[i];
+    processes[i] = processes[big];
+    processes[big] = tmp;
+    i = big;
+  }
+}
+
+/* Move the top_rows processes that sort first to the front, in no
+ * particular order, keeping them in a heap whose root is the worst of
+ * them: O(n log top_rows) instead of sorting everything.  Returns how
+ * many are left to sort and show. */
+static int select_top_procs(int n){
+  int k = top_rows;
+  int i;
+  for(i = k/2; i--; ) sift_down_procs(i, k);
+  for(i = k; i < n; i++){
+    proc_t *tmp;
+    if(compare_two_procs(&processes[i], &processes[0]) >= 0) continue;
+    tmp = processes[0];
+    processes[0] = processes[i];
+    processes[i] = tmp;
+    sift_down_procs(0, k);
+  }
+  return k;
+}
+
 /***** show pre-sorted array of process pointers */
 static void show_proc_array(PROCTAB *restrict ptp, int n, FILE *out_fp){
   proc_t **p = processes;
-  while(n--){
+  int left = -1;
+  // -L and -T print only threads, so --top counts those rows
+  if(top_rows && !(thread_flags & TF_show_proc)) left = top_rows;
+  while(n-- && left){
     if(thread_flags & TF_show_proc) show_one_proc(*p, proc_format_list,out_fp);
     if(thread_flags & TF_show_task){
       static proc_t buf2;         // static avoids memset
       // must still have the process allocated
-      while(readtask(ptp,*p,&buf2)) show_one_proc(&buf2, task_format_list,out_fp);
+      while(left && readtask(ptp,*p,&buf2)){
+        left--;
+        show_one_proc(&buf2, task_format_list,out_fp);
+      }
     }
     p++;
   }
@@ -531,11 +737,11 @@ static int want_this_proc_nop(proc_t *dummy){
 #endif
 
 /***** sorted or forest */
-#define MAX_LINES 50
 static void fancy_spew(FILE *out_fp){
   proc_data_t *pd = NULL;
   PROCTAB *restrict ptp;
   int n = 0;  /* number of processes & index into array */
+  int i;
 
   ptp = openproc(needs_for_format | needs_for_sort | needs_for_select | needs_for_threads);
   if(!ptp) {
@@ -543,20 +749,21 @@ static void fancy_spew(FILE *out_fp){
     exit(1);
   }
 
+  pcpu_tasks = !!(thread_flags & TF_loose_tasks);
   if(thread_flags & TF_loose_tasks){
     pd = readproctab3(want_this_proc_pcpu, ptp);
   }else{
     pd = readproctab2(want_this_proc_pcpu, (void*)0xdeadbeaful, ptp);
   }
   n = pd->n;
-  //n = pd->n < MAX_LINES ? pd->n : MAX_LINES;
+  for(i = 0; i < n; i++) pcpu_record(pd->tab[i], pcpu_tasks);
 
   processes = pd->tab;
 
   if(!n) return;  /* no processes */
   if(forest_type) prep_forest_sort();
+  if(top_rows && top_rows < n) n = select_top_procs(n);
   qsort(processes, n, sizeof(proc_t*), compare_two_procs);
-  //n = pd->n < MAX_LINES ? pd->n : MAX_LINES;
   if(forest_type) show_forest(n,out_fp);
   else show_proc_array(ptp,n,out_fp);
   closeproc(ptp);
@@ -596,6 +803,12 @@ static void arg_check_conflicts(void)
     exit(1);
   }
 
+  /* --top picks rows out of the sort order, a forest needs all of them */
+  if (top_rows && forest_type) {
+    fprintf(stderr, "--top cannot be used together with forest type listings.\n");
+    exit(1);
+  }
+
   /* -q cannot be used with sort */
   if (has_quick_pid && sort_list) {
     fprintf(stderr, "q/-q,--quick-pid cannot be used together with sort options.\n");
@@ -669,8 +882,10 @@ int ps_main(int argc, char *argv[], int out_fd){
 
   lists_and_needs();
 
+  pcpu_begin();
   if(forest_type || sort_list) fancy_spew(out_fp); /* sort or forest */
   else simple_spew(out_fp); /* no sort, no forest */
+  pcpu_end();
   show_one_proc((proc_t *)-1,format_list,out_fp); /* no output yet? */
 
   fclose(out_fp);
@@ -86,6 +86,7 @@ const char     *sysv_fl_format = (const char *)0xdeadbeef;
 const char     *sysv_j_format = (const char *)0xdeadbeef;
 const char     *sysv_l_format = (const char *)0xdeadbeef;
 unsigned        thread_flags = 0xffffffff;
+int             top_rows = -1;
 int             unix_f_option = -1;
 int             user_is_number = -1;
 int             wchan_is_number = -1;
@@ -388,6 +389,7 @@ void reset_global(void){
   simple_select         = 0;
   sort_list             = NULL;
   thread_flags          = 0;
+  top_rows              = 0;     /* --top, 0 means all */
   unix_f_option         = 0;
   user_is_number        = 0;
   wchan_is_number       = 0;
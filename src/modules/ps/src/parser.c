@@ -819,6 +819,7 @@ static const char *parse_gnu_option(void){
   {"rows",          &&case_rows},
   {"sid",           &&case_sid},
   {"sort",          &&case_sort},
+  {"top",           &&case_top},
   {"tty",           &&case_tty},
   {"user",          &&case_user},        /* euid */
   {"version",       &&case_version},
@@ -989,6 +990,19 @@ static const char *parse_gnu_option(void){
     if(!arg) return _("long sort specification must follow --sort");
     defer_sf_option(arg, SF_G_sort);
     return NULL;
+  case_top:
+    trace("--top\n");
+    arg = grab_gnu_arg();
+    if(arg && *arg){
+      long t;
+      char *endptr;
+      t = strtol(arg, &endptr, 0);
+      if(!*endptr && (t>0) && (t<2000000000)){
+        top_rows = (int)t;
+        return NULL;
+      }
+    }
+    return _("number of processes must follow --top");
   case_tty:
     trace("--tty\n");
     arg = grab_gnu_arg();
@@ -26,12 +26,16 @@
 #include <sys/types.h>
 #include <stdlib.h>
 #include <pwd.h>
+#include <pthread.h>
 #include "alloc.h"
 #include "pwcache.h"
 #include <grp.h>
 
 // might as well fill cache lines... else we waste memory anyway
 
+// the parallel /proc scan of readproc.c resolves names from several threads
+static pthread_mutex_t pwcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 #define	HASHSIZE	64		/* power of 2 */
 #define	HASH(x)		((x) & (HASHSIZE - 1))
 
@@ -45,10 +49,13 @@ char *pwcache_get_user(uid_t uid) {
     struct pwbuf **p;
     struct passwd *pw;
 
+    pthread_mutex_lock(&pwcache_lock);
     p = &pwhash[HASH(uid)];
     while (*p) {
-	if ((*p)->uid == uid)
+	if ((*p)->uid == uid) {
+	    pthread_mutex_unlock(&pwcache_lock);
 	    return((*p)->name);
+	}
 	p = &(*p)->next;
     }
     *p = (struct pwbuf *) xmalloc(sizeof(struct pwbuf));
@@ -60,6 +67,7 @@ char *pwcache_get_user(uid_t uid) {
         strcpy((*p)->name, pw->pw_name);
 
     (*p)->next = NULL;
+    pthread_mutex_unlock(&pwcache_lock);
     return((*p)->name);
 }
 
@@ -73,10 +81,13 @@ char *pwcache_get_group(gid_t gid) {
     struct grpbuf **g;
     struct group *gr;
 
+    pthread_mutex_lock(&pwcache_lock);
     g = &grphash[HASH(gid)];
     while (*g) {
-        if ((*g)->gid == gid)
+        if ((*g)->gid == gid) {
+            pthread_mutex_unlock(&pwcache_lock);
             return((*g)->name);
+        }
         g = &(*g)->next;
     }
     *g = (struct grpbuf *) xmalloc(sizeof(struct grpbuf));
@@ -87,5 +98,6 @@ char *pwcache_get_group(gid_t gid) {
     else
         strcpy((*g)->name, gr->gr_name);
     (*g)->next = NULL;
+    pthread_mutex_unlock(&pwcache_lock);
     return((*g)->name);
 }
@@ -26,6 +26,7 @@
 #include "pwcache.h"
 #include "devname.h"
 #include "procps.h"
+#include "workpool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -35,6 +36,7 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #ifdef WITH_SYSTEMD
@@ -59,16 +61,11 @@ extern void __cyg_profile_func_enter(void*,void*);
 
 // utility buffers of MAX_BUFSZ bytes each, available to
 // any function following an openproc() call
-static char *src_buffer,
-            *dst_buffer;
+// ( per thread, so that parallel scan workers can each have their own )
+static __thread char *src_buffer,
+                     *dst_buffer;
 #define MAX_BUFSZ 1024*64*2
 
-// dynamic 'utility' buffer support for file2str() calls
-struct utlbuf_s {
-    char *buf;     // dynamically grown buffer
-    int   siz;     // current len of the above
-} utlbuf_s;
-
 #ifndef SIGNAL_STRING
 // convert hex string to unsigned long long
 static unsigned long long unhex(const char *restrict cp){
@@ -83,6 +80,7 @@ static unsigned long long unhex(const char *restrict cp){
 #endif
 
 static int task_dir_missing;
+static unsigned long page_kb;           // stat reports rss in pages
 
 // free any additional dynamically acquired storage associated with a proc_t
 // ( and if it's to be reused, refresh it otherwise destroy it )
@@ -112,7 +110,7 @@ static inline void free_acquired (proc_t *p, int reuse) {
 ///////////////////////////////////////////////////////////////////////////
 
 typedef struct status_table_struct {
-    unsigned char name[8];        // /proc/*/status field name
+    unsigned char name[27];       // /proc/*/status field name
     unsigned char len;            // name length
 #ifdef LABEL_OFFSET
     long offset;                  // jump address offset
@@ -148,6 +146,10 @@ typedef struct status_table_struct {
 // In the status_table_struct watch out for name size (grrr, expanding)
 // and the number of entries. Currently, the table is padded to 128
 // entries and we therefore mask with 127.
+//
+// The two *_ctxt_switches keys were fitted in by hand: 'l', 'n' and 'v'
+// occur in no other key at positions 1,3,4, so their asso values only
+// steer those two names into free slots (2 and 42).
 
 static void status2proc(char *S, proc_t *restrict P, int is_proc){
     long Threads = 0;
@@ -167,15 +169,16 @@ static void status2proc(char *S, proc_t *restrict P, int is_proc){
        50,  10,   0,  35, 101, 101,  21, 101,  30, 101,
        20,  36,   0,   5,   0,  40,   0,   0, 101, 101,
       101, 101, 101, 101, 101, 101, 101,  30, 101,  15,
-        0,   1, 101,  10, 101,  10, 101, 101, 101,  25,
-      101,  40,   0, 101,   0,  50,   6,  40, 101,   1,
+        0,   1, 101,  10, 101,  10, 101, 101,   0,  25,
+        0,  40,   0, 101,   0,  50,   6,  40,   2,   1,
        35, 101, 101, 101, 101, 101, 101, 101
     };
 
     static const status_table_struct table[GPERF_TABLE_SIZE] = {
       F(VmHWM)
       F(Threads)
-      NUL NUL NUL
+      F(nonvoluntary_ctxt_switches)
+      NUL NUL
       F(VmRSS)
       F(VmSwap)
       NUL NUL NUL
@@ -199,7 +202,8 @@ static void status2proc(char *S, proc_t *restrict P, int is_proc){
       NUL NUL NUL
       F(SigCgt)
       F(State)
-      NUL NUL NUL
+      F(voluntary_ctxt_switches)
+      NUL NUL
       F(CapPrm)
       F(Uid)
       NUL NUL NUL
@@ -379,6 +383,12 @@ ENTER(0x220);
     case_VmSwap: // Linux 2.6.34
         P->vm_swap = strtol(S,&S,10);
         continue;
+    case_voluntary_ctxt_switches:
+        P->nvcsw = strtoul(S,&S,10);
+        continue;
+    case_nonvoluntary_ctxt_switches:
+        P->nivcsw = strtoul(S,&S,10);
+        continue;
     case_Groups:
     {   char *nl = strchr(S, '\n');
         int j = nl ? (nl - S) : strlen(S);
@@ -631,6 +641,41 @@ static void statm2proc(const char* s, proc_t *restrict P) {
 /*    fprintf(stderr, "statm2proc converted %d fields.\n",num); */
 }
 
+// Without status, derive its two most used sizes from stat: the kernel
+// computes VmSize and VmRSS from the same counters as vsize and rss.
+static void stat2vm(proc_t *restrict P) {
+    P->vm_size = P->vsize >> 10;
+    P->vm_rss  = P->rss * page_kb;
+}
+
+// Like file2str, but also fstat()s the open file.  Every /proc/#/ entry is
+// owned by the task's euid/egid, so this replaces a separate stat() of the
+// directory while that file has to be read anyway.
+static int file2str_owner(const char *directory, const char *what, struct utlbuf_s *ub, struct stat *sb) {
+ #define buffGRW 1024
+    char path[PROCPATHLEN];
+    int fd, num, tot_read = 0;
+
+    if (ub->buf) ub->buf[0] = '\0';
+    else ub->buf = xcalloc((ub->siz = buffGRW));
+    sprintf(path, "%s/%s", directory, what);
+    if (-1 == (fd = open(path, O_RDONLY, 0))) return -1;
+    if (unlikely(fstat(fd, sb) == -1)) {
+        close(fd);
+        return -1;
+    }
+    while (0 < (num = read(fd, ub->buf + tot_read, ub->siz - tot_read))) {
+        tot_read += num;
+        if (tot_read < ub->siz) break;
+        ub->buf = xrealloc(ub->buf, (ub->siz += buffGRW));
+    };
+    ub->buf[tot_read] = '\0';
+    close(fd);
+    if (unlikely(tot_read < 1)) return -1;
+    return tot_read;
+ #undef buffGRW
+}
+
 static int file2str(const char *directory, const char *what, struct utlbuf_s *ub) {
  #define buffGRW 1024
     char path[PROCPATHLEN];
@@ -716,6 +761,91 @@ static char** file2strvec(const char* directory, const char* what) {
     return ret;
 }
 
+/////////////////////////////////////////////////////////////////////////
+// cmdline and cgroup stay the same for the life of a process, and lepd
+// lists processes over and over, so simple_readproc keeps them across
+// openproc() calls.  Slots are keyed by tid and checked against start_time
+// (pid reuse) and comm (exec); a later setproctitle() style rewrite shows
+// up once the slot is reused.  Direct mapped: a collision only costs the
+// read we would have done anyway.
+
+#define ATTR_CACHE_SIZE 4096            // power of 2
+#define ATTR_CMDLINE    0x1
+#define ATTR_CGROUP     0x2
+
+typedef struct attr_cache_ent {
+    int tid;
+    unsigned long long start_time;
+    char cmd[16];
+    unsigned have;                      // ATTR_* bits already read
+    char **cmdline;                     // NULL when the file was empty
+    char **cgroup;
+} attr_cache_ent;
+
+static attr_cache_ent attr_cache[ATTR_CACHE_SIZE];
+static pthread_mutex_t attr_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// copy a file2strvec() style block, the kind released with free(*vec)
+static char** strvec_dup(char **vec) {
+    char *base, *copy;
+    char **ret;
+    size_t n, size;
+
+    if (!vec) return NULL;
+    for (n = 0; vec[n]; n++) ;
+    base = vec[0];
+    size = (char*)(vec + n + 1) - base;
+    copy = xmalloc(size);
+    memcpy(copy, base, size);
+    ret = (char**)(copy + ((char*)vec - base));
+    for (n = 0; vec[n]; n++)
+        ret[n] = copy + (vec[n] - base);
+    return ret;
+}
+
+// slot for p, emptied first if it holds some other (or older) task
+static attr_cache_ent* attr_cache_slot(const proc_t *restrict p) {
+    attr_cache_ent *e = &attr_cache[(p->tid * 2654435761u) & (ATTR_CACHE_SIZE - 1)];
+
+    if (e->tid == p->tid && e->start_time == p->start_time
+    && !strncmp(e->cmd, p->cmd, sizeof e->cmd))
+        return e;
+    if (e->cmdline) free(*e->cmdline);
+    if (e->cgroup)  free(*e->cgroup);
+    memset(e, 0, sizeof(*e));
+    e->tid = p->tid;
+    e->start_time = p->start_time;
+    memcpy(e->cmd, p->cmd, sizeof e->cmd);
+    return e;
+}
+
+// file2strvec(directory, what) through the cache; p needs stat2proc data
+static char** cached_strvec(const char *directory, const char *what, unsigned attr, const proc_t *restrict p) {
+    attr_cache_ent *e;
+    char **vec;
+
+    pthread_mutex_lock(&attr_cache_lock);
+    e = attr_cache_slot(p);
+    if (e->have & attr) {
+        vec = strvec_dup(attr == ATTR_CMDLINE ? e->cmdline : e->cgroup);
+        pthread_mutex_unlock(&attr_cache_lock);
+        return vec;
+    }
+    pthread_mutex_unlock(&attr_cache_lock);
+
+    vec = file2strvec(directory, what);         // no lock held for the read
+
+    pthread_mutex_lock(&attr_cache_lock);
+    e = attr_cache_slot(p);
+    if (!(e->have & attr)) {
+        if (attr == ATTR_CMDLINE) e->cmdline = strvec_dup(vec);
+        else                      e->cgroup  = strvec_dup(vec);
+        e->have |= attr;
+    }
+    pthread_mutex_unlock(&attr_cache_lock);
+    return vec;
+}
+
     // this is the former under utilized 'read_cmdline', which has been
     // generalized in support of these new libproc flags:
     //     PROC_EDITCGRPCVT, PROC_EDITCMDLCVT and PROC_EDITENVRCVT
@@ -917,12 +1047,15 @@ static const char *lxc_containers (const char *path) {
 // The pid (tgid? tid?) is already in p, and a path to it in path, with some
 // room to spare.
 static proc_t* simple_readproc(PROCTAB *restrict const PT, proc_t *restrict const p) {
-    static struct utlbuf_s ub = { NULL, 0 };    // buf for stat,statm,status
-    static struct stat sb;     // stat() buffer
+    struct utlbuf_s *const ubp = &PT->ub;       // buf for stat,statm,status
+    struct stat sb;            // stat() buffer
     char *restrict const path = PT->path;
     unsigned flags = PT->flags;
 
-    if (unlikely(stat(path, &sb) == -1))        /* no such dirent (anymore) */
+    if (flags & PROC_FILLSTAT) {                // read /proc/#/stat
+        if (unlikely(file2str_owner(path, "stat", ubp, &sb) == -1))
+            goto next_proc;
+    } else if (unlikely(stat(path, &sb) == -1)) /* no such dirent (anymore) */
         goto next_proc;
 
     if ((flags & PROC_UID) && !XinLN(uid_t, sb.st_uid, PT->uids, PT->nuid))
@@ -931,24 +1064,22 @@ static proc_t* simple_readproc(PROCTAB *restrict const PT, proc_t *restrict cons
     p->euid = sb.st_uid;                        /* need a way to get real uid */
     p->egid = sb.st_gid;                        /* need a way to get real gid */
 
-    if (flags & PROC_FILLSTAT) {                // read /proc/#/stat
-        if (unlikely(file2str(path, "stat", &ub) == -1))
-            goto next_proc;
-        stat2proc(ub.buf, p);
-    }
+    if (flags & PROC_FILLSTAT)
+        stat2proc(ubp->buf, p);
 
     if (flags & PROC_FILLMEM) {                 // read /proc/#/statm
-        if (likely(file2str(path, "statm", &ub) != -1))
-            statm2proc(ub.buf, p);
+        if (likely(file2str(path, "statm", ubp) != -1))
+            statm2proc(ubp->buf, p);
     }
 
     if (flags & PROC_FILLSTATUS) {              // read /proc/#/status
-        if (likely(file2str(path, "status", &ub) != -1)){
-            status2proc(ub.buf, p, 1);
+        if (likely(file2str(path, "status", ubp) != -1)){
+            status2proc(ubp->buf, p, 1);
             if (flags & PROC_FILLSUPGRP)
                 supgrps_from_supgids(p);
         }
-    }
+    } else if (flags & PROC_FILLSTAT)
+        stat2vm(p);
 
     // if multithreaded, some values are crap
     if(p->nlwp > 1){
@@ -986,6 +1117,9 @@ static proc_t* simple_readproc(PROCTAB *restrict const PT, proc_t *restrict cons
         //if (flags & PROC_EDITCMDLCVT)
           //  fill_cmdline_cvt(path, p);
         //else
+        if (flags & PROC_FILLSTAT)
+            p->cmdline = cached_strvec(path, "cmdline", ATTR_CMDLINE, p);
+        else
             p->cmdline = file2strvec(path, "cmdline");
     }
 
@@ -993,14 +1127,17 @@ static proc_t* simple_readproc(PROCTAB *restrict const PT, proc_t *restrict cons
         //if (flags & PROC_EDITCGRPCVT)
           //  fill_cgroup_cvt(path, p);
         //else
+        if (flags & PROC_FILLSTAT)
+            p->cgroup = cached_strvec(path, "cgroup", ATTR_CGROUP, p);
+        else
             p->cgroup = file2strvec(path, "cgroup");
     }
 
     if (unlikely(flags & PROC_FILLOOM)) {
-        if (likely(file2str(path, "oom_score", &ub) != -1))
-            oomscore2proc(ub.buf, p);
-        if (likely(file2str(path, "oom_adj", &ub) != -1))
-            oomadj2proc(ub.buf, p);
+        if (likely(file2str(path, "oom_score", ubp) != -1))
+            oomscore2proc(ubp->buf, p);
+        if (likely(file2str(path, "oom_adj", ubp) != -1))
+            oomadj2proc(ubp->buf, p);
     }
 
     if (unlikely(flags & PROC_FILLNS))          // read /proc/#/ns/*
@@ -1027,11 +1164,14 @@ next_proc:
 // t is the POSIX thread (task group member, generally not the leader)
 // path is a path to the task, with some room to spare.
 static proc_t* simple_readtask(PROCTAB *restrict const PT, const proc_t *restrict const p, proc_t *restrict const t, char *restrict const path) {
-    static struct utlbuf_s ub = { NULL, 0 };    // buf for stat,statm,status
-    static struct stat sb;     // stat() buffer
+    struct utlbuf_s *const ubp = &PT->ub;       // buf for stat,statm,status
+    struct stat sb;            // stat() buffer
     unsigned flags = PT->flags;
 
-    if (unlikely(stat(path, &sb) == -1))        /* no such dirent (anymore) */
+    if (flags & PROC_FILLSTAT) {                        // read /proc/#/task/#/stat
+        if (unlikely(file2str_owner(path, "stat", ubp, &sb) == -1))
+            goto next_task;
+    } else if (unlikely(stat(path, &sb) == -1))         /* no such dirent (anymore) */
         goto next_task;
 
 //  if ((flags & PROC_UID) && !XinLN(uid_t, sb.st_uid, PT->uids, PT->nuid))
@@ -1040,27 +1180,25 @@ static proc_t* simple_readtask(PROCTAB *restrict const PT, const proc_t *restric
     t->euid = sb.st_uid;                        /* need a way to get real uid */
     t->egid = sb.st_gid;                        /* need a way to get real gid */
 
-    if (flags & PROC_FILLSTAT) {                        // read /proc/#/task/#/stat
-        if (unlikely(file2str(path, "stat", &ub) == -1))
-            goto next_task;
-        stat2proc(ub.buf, t);
-    }
+    if (flags & PROC_FILLSTAT)
+        stat2proc(ubp->buf, t);
 
 #ifndef QUICK_THREADS
     if (flags & PROC_FILLMEM)                           // read /proc/#/task/#statm
-        if (likely(file2str(path, "statm", &ub) != -1))
-            statm2proc(ub.buf, t);
+        if (likely(file2str(path, "statm", ubp) != -1))
+            statm2proc(ubp->buf, t);
 #endif
 
     if (flags & PROC_FILLSTATUS) {                      // read /proc/#/task/#/status
-        if (likely(file2str(path, "status", &ub) != -1)) {
-            status2proc(ub.buf, t, 0);
+        if (likely(file2str(path, "status", ubp) != -1)) {
+            status2proc(ubp->buf, t, 0);
 #ifndef QUICK_THREADS
             if (flags & PROC_FILLSUPGRP)
                 supgrps_from_supgids(t);
 #endif
         }
-    }
+    } else if (flags & PROC_FILLSTAT)
+        stat2vm(t);
 
     /* some number->text resolving which is time consuming */
     if (flags & PROC_FILLUSR){
@@ -1085,8 +1223,8 @@ static proc_t* simple_readtask(PROCTAB *restrict const PT, const proc_t *restric
 #ifdef QUICK_THREADS
     if (!p) {
         if (flags & PROC_FILLMEM)
-            if (likely(file2str(path, "statm", &ub) != -1))
-                statm2proc(ub.buf, t);
+            if (likely(file2str(path, "statm", ubp) != -1))
+                statm2proc(ubp->buf, t);
 
         if (flags & PROC_FILLSUPGRP)
             supgrps_from_supgids(t);
@@ -1147,10 +1285,10 @@ static proc_t* simple_readtask(PROCTAB *restrict const PT, const proc_t *restric
 #endif
 
     if (unlikely(flags & PROC_FILLOOM)) {
-        if (likely(file2str(path, "oom_score", &ub) != -1))
-            oomscore2proc(ub.buf, t);
-        if (likely(file2str(path, "oom_adj", &ub) != -1))
-            oomadj2proc(ub.buf, t);
+        if (likely(file2str(path, "oom_score", ubp) != -1))
+            oomscore2proc(ubp->buf, t);
+        if (likely(file2str(path, "oom_adj", ubp) != -1))
+            oomadj2proc(ubp->buf, t);
     }
 
     if (unlikely(flags & PROC_FILLNS))                  // read /proc/#/task/#/ns/*
@@ -1168,7 +1306,7 @@ next_task:
 // This finds processes in /proc in the traditional way.
 // Return non-zero on success.
 static int simple_nextpid(PROCTAB *restrict const PT, proc_t *restrict const p) {
-  static struct dirent *ent;		/* dirent handle */
+  struct dirent *ent;			/* dirent handle */
   char *restrict const path = PT->path;
   for (;;) {
     ent = readdir(PT->procfs);
@@ -1186,7 +1324,7 @@ static int simple_nextpid(PROCTAB *restrict const PT, proc_t *restrict const p)
 // This finds tasks in /proc/*/task/ in the traditional way.
 // Return non-zero on success.
 static int simple_nexttid(PROCTAB *restrict const PT, const proc_t *restrict const p, proc_t *restrict const t, char *restrict const path) {
-  static struct dirent *ent;		/* dirent handle */
+  struct dirent *ent;			/* dirent handle */
   if(PT->taskdir_user != p->tgid){
     if(PT->taskdir){
       closedir(PT->taskdir);
@@ -1371,6 +1509,7 @@ PROCTAB* openproc(int flags, ...) {
 
     if (!did_stat){
         task_dir_missing = stat("/proc/self/task", &sbuf);
+        page_kb = sysconf(_SC_PAGESIZE) >> 10;
         did_stat = 1;
     }
     PT->taskdir = NULL;
@@ -1388,6 +1527,8 @@ PROCTAB* openproc(int flags, ...) {
         PT->finder = simple_nextpid;
     }
     PT->flags = flags;
+    PT->ub.buf = NULL;
+    PT->ub.siz = 0;
 
     va_start(ap, flags);
     if (flags & PROC_PID)
@@ -1410,6 +1551,7 @@ void closeproc(PROCTAB* PT) {
     if (PT){
         if (PT->procfs) closedir(PT->procfs);
         if (PT->taskdir) closedir(PT->taskdir);
+        if (PT->ub.buf) free(PT->ub.buf);
         memset(PT,'#',sizeof(PROCTAB));
         free(PT);
     }
@@ -1478,6 +1620,239 @@ proc_t** readproctab(int flags, ...) {
     return tab;
 }
 
+//////////////////////////////////////////////////////////////////////////////////
+// Parallel scan for readproctab2/readproctab3.  The pids found by readdir are
+// handed out in chunks to a few workers, each with a private copy of the
+// PROCTAB (path, taskdir and utility buffer) and its own proc_t pool.  The
+// pools live on between scans, so their proc_t storage is recycled instead
+// of reallocated.  The results are merged back into readdir order, so that
+// ties in the callers' qsort come out as they did with a sequential scan.
+#define SCAN_MAX_WORKERS 8
+#define SCAN_MIN_PIDS    128   // per extra worker, below this threads don't pay
+#define SCAN_CHUNK       16    // pids handed out at a time
+
+typedef struct scan_ent {
+    unsigned slot;             // index into the pool's data
+    unsigned order;            // index of the pid in scan_job.pids
+} scan_ent;
+
+typedef struct scan_pool {
+    PROCTAB PT;                // private copy of the caller's PROCTAB
+    struct utlbuf_s ub;        // kept across scans
+    proc_t *data;              // proc_t pool, entries [0, n_used) are valid
+    unsigned n_alloc, n_used;
+    scan_ent *ptab;            // kept processes, in pid order
+    unsigned n_proc, n_proc_alloc;
+    scan_ent *ttab;            // kept tasks, in pid order
+    unsigned n_task, n_task_alloc;
+} scan_pool;
+
+static struct scan_job {
+    pid_t *pids;
+    int either;                // readproctab3: every task is a process
+    int(*want_proc)(proc_t *buf);
+    int(*want_task)(proc_t *buf);
+} scan_job;
+
+static scan_pool scan_pools[SCAN_MAX_WORKERS];
+
+// next free slot of the pool, cleared; does not take it
+static unsigned scan_slot(scan_pool *sp) {
+    if (sp->n_used == sp->n_alloc) {
+        unsigned old = sp->n_alloc;
+        sp->n_alloc = sp->n_alloc*5/4+30;  // grow by over 25%
+        sp->data = xrealloc(sp->data, sizeof(proc_t)*sp->n_alloc);
+        memset(sp->data+old, 0, sizeof(proc_t)*(sp->n_alloc-old));
+    }
+    free_acquired(sp->data+sp->n_used, 1);  // recycle what an earlier scan left
+    return sp->n_used;
+}
+
+static void scan_keep(scan_ent **tab, unsigned *n, unsigned *n_alloc, scan_pool *sp, unsigned order) {
+    if (*n == *n_alloc) {
+        *n_alloc = *n_alloc*5/4+30;
+        *tab = xrealloc(*tab, sizeof(scan_ent)*(*n_alloc));
+    }
+    (*tab)[*n].slot = sp->n_used++;
+    (*tab)[*n].order = order;
+    (*n)++;
+}
+
+// merge the workers' tables, each already in pid order, into tab
+static unsigned scan_merge(proc_t **tab, int nworkers, int tasks) {
+    unsigned pos[SCAN_MAX_WORKERS] = { 0 };
+    unsigned n = 0;
+
+    for (;;) {
+        scan_ent *best = NULL;
+        int w, bw = 0;
+        for (w = 0; w < nworkers; w++) {
+            scan_pool *sp = &scan_pools[w];
+            scan_ent *e = tasks ? sp->ttab : sp->ptab;
+            if (pos[w] == (tasks ? sp->n_task : sp->n_proc)) continue;
+            if (!best || e[pos[w]].order < best->order) {
+                best = &e[pos[w]];
+                bw = w;
+            }
+        }
+        if (!best) return n;
+        tab[n++] = scan_pools[bw].data + best->slot;
+        pos[bw]++;
+    }
+}
+
+static void scan_one(scan_pool *sp, unsigned order) {
+    PROCTAB *restrict const PT = &sp->PT;
+    pid_t pid = scan_job.pids[order];
+    char path[PROCPATHLEN];
+    proc_t *p, *t;
+    unsigned pi;
+
+    snprintf(PT->path, PROCPATHLEN, "/proc/%d", pid);
+
+    if (scan_job.either) {                     // same walk as readeither
+        proc_t skel;                           // only tgid is used
+        if (task_dir_missing) {
+            pi = scan_slot(sp);                // may move the pool
+            p = sp->data + pi;
+            p->tgid = p->tid = pid;
+            if (PT->reader(PT, p) && scan_job.want_task(p))
+                scan_keep(&sp->ptab, &sp->n_proc, &sp->n_proc_alloc, sp, order);
+            return;
+        }
+        skel.tgid = skel.tid = pid;
+        for (;;) {
+            unsigned ti = scan_slot(sp);       // may move the pool
+            t = sp->data + ti;
+            if (!PT->taskfinder(PT, &skel, t, path)) break;   // simple_nexttid
+            if (!PT->taskreader(PT, NULL, t, path)) break;    // simple_readtask
+            if (scan_job.want_task(t))
+                scan_keep(&sp->ptab, &sp->n_proc, &sp->n_proc_alloc, sp, order);
+        }
+        return;
+    }
+
+    pi = scan_slot(sp);
+    p = sp->data + pi;
+    p->tgid = p->tid = pid;
+    if (!PT->reader(PT, p) || !scan_job.want_proc(p)) return;  // slot is reused
+    scan_keep(&sp->ptab, &sp->n_proc, &sp->n_proc_alloc, sp, order);
+    if (!(PT->flags & PROC_LOOSE_TASKS)) return;
+
+    PT->did_fake = 0;
+    for (;;) {
+        unsigned ti = scan_slot(sp);           // may move the pool, so index p
+        t = readtask_direct(PT, sp->data + pi, sp->data + ti);
+        if (!t) break;
+        if (scan_job.want_task(t))
+            scan_keep(&sp->ttab, &sp->n_task, &sp->n_task_alloc, sp, order);
+    }
+}
+
+static void scan_worker(struct workpool *wp, int w) {
+    scan_pool *sp = &scan_pools[w];
+    int own_buffers = !src_buffer;             // the caller's thread has them
+    size_t i, end;
+
+    if (own_buffers) {
+        src_buffer = xmalloc(MAX_BUFSZ);
+        dst_buffer = xmalloc(MAX_BUFSZ);
+    }
+    while (workpool_next(wp, &i, &end))
+        for (; i < end; i++)
+            scan_one(sp, i);
+    if (own_buffers) {
+        free(src_buffer);
+        free(dst_buffer);
+        src_buffer = dst_buffer = NULL;
+    }
+}
+
+// can PT be scanned by scan_readproctab?
+static int scan_parallel_ok(const PROCTAB *restrict const PT) {
+    // a plain /proc walk; lxc and systemd lookups are not thread safe
+    return PT->finder == simple_nextpid
+        && !(PT->flags & (PROC_FILL_LXC | PROC_FILLSYSTEMD));
+}
+
+static proc_data_t *scan_readproctab(int(*want_proc)(proc_t *buf), int(*want_task)(proc_t *buf), PROCTAB *restrict const PT, int either) {
+    static proc_data_t pd;
+    static pid_t *pids = NULL;
+    static unsigned n_pids_alloc = 0;
+    static proc_t **ptab = NULL, **ttab = NULL;
+    static unsigned n_ptab_alloc = 0, n_ttab_alloc = 0;
+    struct workpool wp;
+    struct dirent *ent;
+    unsigned npids = 0, n_proc = 0, n_task = 0;
+    int nworkers, w;
+
+    while ((ent = readdir(PT->procfs))) {
+        if (*ent->d_name <= '0' || *ent->d_name > '9') continue;
+        if (npids == n_pids_alloc) {
+            n_pids_alloc = n_pids_alloc*5/4+256;
+            pids = xrealloc(pids, sizeof(pid_t)*n_pids_alloc);
+        }
+        pids[npids++] = strtoul(ent->d_name, NULL, 10);
+    }
+
+    nworkers = workpool_size(npids, SCAN_MAX_WORKERS, SCAN_MIN_PIDS);
+
+    scan_job.pids = pids;
+    scan_job.either = either;
+    scan_job.want_proc = want_proc;
+    scan_job.want_task = want_task;
+
+    for (w = 0; w < nworkers; w++) {
+        scan_pool *sp = &scan_pools[w];
+        memcpy(&sp->PT, PT, sizeof(PROCTAB));
+        sp->PT.procfs = NULL;
+        sp->PT.taskdir = NULL;
+        sp->PT.taskdir_user = -1;
+        sp->PT.ub = sp->ub;
+        sp->n_used = sp->n_proc = sp->n_task = 0;
+    }
+
+    // worker 0 is this thread; a worker that fails to start is covered by the others
+    wp.n = npids;
+    wp.chunk = SCAN_CHUNK;
+    wp.worker = scan_worker;
+    wp.arg = NULL;
+    workpool_run(&wp, nworkers);
+
+    for (w = 0; w < nworkers; w++) {
+        scan_pool *sp = &scan_pools[w];
+        if (sp->PT.taskdir) closedir(sp->PT.taskdir);
+        sp->ub = sp->PT.ub;
+        n_proc += sp->n_proc;
+        n_task += sp->n_task;
+    }
+
+    // merge: pool indexes become pointers
+    if (n_proc >= n_ptab_alloc) {
+        n_ptab_alloc = n_proc + 1;
+        ptab = xrealloc(ptab, sizeof(proc_t*)*n_ptab_alloc);
+    }
+    if (n_task >= n_ttab_alloc) {
+        n_ttab_alloc = n_task + 1;
+        ttab = xrealloc(ttab, sizeof(proc_t*)*n_ttab_alloc);
+    }
+    n_proc = scan_merge(ptab, nworkers, 0);
+    n_task = scan_merge(ttab, nworkers, 1);
+
+    pd.proc  = ptab;
+    pd.task  = ttab;
+    pd.nproc = n_proc;
+    pd.ntask = n_task;
+    if(!either && (PT->flags & PROC_LOOSE_TASKS)){
+      pd.tab = ttab;
+      pd.n   = n_task;
+    }else{
+      pd.tab = ptab;
+      pd.n   = n_proc;
+    }
+    return &pd;
+}
+
 // Try again, this time with threads and selection.
 proc_data_t *readproctab2(int(*want_proc)(proc_t *buf), int(*want_task)(proc_t *buf), PROCTAB *restrict const PT) {
     static proc_data_t pd;
@@ -1493,6 +1868,9 @@ proc_data_t *readproctab2(int(*want_proc)(proc_t *buf), int(*want_task)(proc_t *
     unsigned n_alloc = 0;
     unsigned long n_used = 0;
 
+    if (scan_parallel_ok(PT))
+        return scan_readproctab(want_proc, want_task, PT, 0);
+
     for(;;){
         proc_t *tmp;
         if(n_alloc == n_used){
@@ -1559,6 +1937,9 @@ proc_data_t *readproctab3 (int(*want_task)(proc_t *buf), PROCTAB *restrict const
     unsigned n_used = 0;
     proc_t *p = NULL;
 
+    if (scan_parallel_ok(PT))
+        return scan_readproctab(NULL, want_task, PT, 1);
+
     for (;;) {
         if (n_alloc == n_used) {
             n_alloc = n_alloc*5/4+30;  // grow by over 25%
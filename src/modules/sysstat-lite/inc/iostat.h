@@ -91,6 +91,15 @@ struct io_stats {
 	unsigned int  tot_ticks		__attribute__ ((packed));
 	/* # of ticks requests spent in queue */
 	unsigned int  rq_ticks		__attribute__ ((packed));
+	/* # of discard operations, merges and sectors (kernel 4.18+) */
+	unsigned long dc_ios		__attribute__ ((packed));
+	unsigned long dc_merges		__attribute__ ((packed));
+	unsigned long dc_sectors	__attribute__ ((packed));
+	/* # of flush operations (kernel 5.5+) */
+	unsigned long fl_ios		__attribute__ ((packed));
+	/* Time of discard and flush requests in queue */
+	unsigned int  dc_ticks		__attribute__ ((packed));
+	unsigned int  fl_ticks		__attribute__ ((packed));
 };
 
 #define IO_STATS_SIZE	(sizeof(struct io_stats))
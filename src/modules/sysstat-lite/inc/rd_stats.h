@@ -6,6 +6,7 @@
 #ifndef _RD_STATS_H
 #define _RD_STATS_H
 
+#include "procstat.h"
 
 /*
  ***************************************************************************
@@ -568,6 +569,87 @@ struct stats_fchost {
 
 #define STATS_FCHOST_SIZE	(sizeof(struct stats_fchost))
 
+/*
+ * A /proc file kept open between samples, and the buffer it is read into.
+ * Each user owns its own, so the readers below can run in any thread.
+ */
+struct proc_file {
+	const char *path;
+	int fd;
+	char *buf;
+	size_t size;
+};
+
+#define PROC_FILE_INIT(path)	{ (path), -1, NULL, 0 }
+
+/* Longest block device name (DISK_NAME_LEN in the kernel) */
+#define DISKSTATS_NAME_LEN	32
+
+/*
+ * One line of /proc/diskstats. The counters are in the order of the file,
+ * so that they can be read as an array.
+ */
+struct diskstats_dev {
+	unsigned int major;
+	unsigned int minor;
+	char name[DISKSTATS_NAME_LEN];
+	/* Number of counters on the line: 4 for old style partitions, else 11,
+	 * 15 with discard counters (4.18) or 17 with flush counters (5.5) */
+	int nr_fields;
+	unsigned long long rd_ios;
+	unsigned long long rd_merges;
+	unsigned long long rd_sectors;
+	unsigned long long rd_ticks;	/* ms */
+	unsigned long long wr_ios;
+	unsigned long long wr_merges;
+	unsigned long long wr_sectors;
+	unsigned long long wr_ticks;
+	unsigned long long ios_pgr;
+	unsigned long long tot_ticks;
+	unsigned long long rq_ticks;
+	unsigned long long dc_ios;
+	unsigned long long dc_merges;
+	unsigned long long dc_sectors;
+	unsigned long long dc_ticks;
+	unsigned long long fl_ios;
+	unsigned long long fl_ticks;
+};
+
+#define DISKSTATS_NR_FIELDS	11
+#define DISKSTATS_MAX_FIELDS	17
+
+/* /proc/diskstats at a given time. The dev array only grows. */
+struct diskstats_snap {
+	unsigned long long uptime_ms;	/* CLOCK_BOOTTIME when read */
+	int nr_dev;
+	int dev_alloc;
+	struct diskstats_dev *dev;
+};
+
+/* Extended statistics of a device over an interval (iostat -x) */
+struct diskstats_rates {
+	double rd_ios;		/* r/s */
+	double wr_ios;		/* w/s */
+	double rd_merges;	/* rrqm/s */
+	double wr_merges;	/* wrqm/s */
+	double rd_kb;		/* rkB/s */
+	double wr_kb;		/* wkB/s */
+	double r_await;		/* ms */
+	double w_await;		/* ms */
+	double await;		/* ms */
+	double svctm;		/* ms */
+	double aqu_sz;		/* average queue size */
+	double arqsz;		/* average request size, in sectors */
+	double util;		/* % */
+	/* Zero when the kernel has no discard or flush counters */
+	double dc_ios;		/* d/s */
+	double dc_merges;	/* drqm/s */
+	double dc_kb;		/* dkB/s */
+	double d_await;		/* ms */
+	double fl_ios;		/* f/s */
+	double f_await;		/* ms */
+};
+
 /*
  ***************************************************************************
  * Prototypes for functions used to read system statistics
@@ -576,14 +658,30 @@ struct stats_fchost {
 
 void oct2chr
 	(char *);
+char *read_proc_file
+	(struct proc_file *);
+int parse_proc_ull
+	(char **, unsigned long long *);
+char *next_proc_line
+	(char *);
+void close_proc_file
+	(struct proc_file *);
+void read_stat_snapshot
+	(struct procstat *);
 void read_stat_cpu
-	(struct stats_cpu *, int, unsigned long long *, unsigned long long *);
+	(const struct procstat *, struct stats_cpu *, int, unsigned long long *,
+	 unsigned long long *);
 void read_stat_irq
-	(struct stats_irq *, int);
+	(const struct procstat *, struct stats_irq *);
 void read_meminfo
-	(struct stats_memory *);
+	(struct proc_file *, struct stats_memory *);
 void read_uptime
-	(unsigned long long *);
+	(struct proc_file *, unsigned long long *);
+int read_diskstats_snap
+	(struct proc_file *, struct diskstats_snap *);
+void compute_diskstats_rates
+	(const struct diskstats_dev *, const struct diskstats_dev *,
+	 unsigned long long, struct diskstats_rates *);
 void read_stat_pcsw
 	(struct stats_pcsw *);
 void read_loadavg
@@ -0,0 +1,432 @@
+/*
+ * diskstat.c: iostat -x over a chosen window, without sleeping
+ *
+ * iostat has to sleep for the length of its interval.  diskstat keeps a
+ * ring of /proc/diskstats snapshots, at most one per second, filled by
+ * its own calls, and computes the extended statistics between the current
+ * state and the snapshot closest to the requested window:
+ *
+ *	diskstat [-w SECONDS] [-q]
+ *
+ * The window defaults to one second.  When the ring doesn't reach that far
+ * back, its oldest snapshot is used, and the first call reports averages
+ * since boot; "interval_ms" always gives the window actually used.  The
+ * columns are those of "iostat -d -x -k", followed by the discard and
+ * flush statistics (zero on kernels without them) and the reads and
+ * writes in flight right now.
+ *
+ * With -q, each blk-mq hardware queue of the listed devices gets a line:
+ * its tags, its CPUs and, when debugfs is mounted, how often it was run,
+ * requests queued on it and completed by its CPUs.  Those rates are since
+ * the previous -q call ("hctx_interval_ms"), and "-" when the kernel
+ * doesn't export the counter (recent kernels dropped queued and completed).
+ *
+ * Licensed under GPLv2 or later.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "rd_stats.h"
+
+/* Snapshots kept, and minimum time between two of them */
+#define DISKSTAT_RING		64
+#define DISKSTAT_STEP_MS	1000
+
+#define DEBUGFS_BLOCK		"/sys/kernel/debug/block"
+#define HCTX_CPUS_LEN		32
+
+/* Counters of a hardware queue found in debugfs */
+#define HCTX_RUN		0x01
+#define HCTX_QUEUED		0x02
+#define HCTX_COMPLETED		0x04
+
+/* One blk-mq hardware queue */
+struct hctx_stat {
+	unsigned int major;
+	unsigned int minor;
+	int id;
+	int dev;			/* index in the snapshot it was read with */
+	int nr_tags;
+	char cpus[HCTX_CPUS_LEN];	/* "0,1,2", from mq/N/cpu_list */
+	unsigned int have;		/* HCTX_* counters read */
+	unsigned long long run;
+	unsigned long long queued;
+	unsigned long long completed;	/* reads and writes */
+};
+
+struct hctx_sample {
+	unsigned long long uptime_ms;
+	int nr;
+	int alloc;
+	struct hctx_stat *hctx;
+};
+
+static struct proc_file diskstats_file = PROC_FILE_INIT(DISKSTATS);
+static struct diskstats_snap ring[DISKSTAT_RING];
+static int ring_head = -1;		/* newest snapshot, -1 if none */
+static int ring_nr;
+static struct diskstats_snap spare;	/* where the current state is read */
+
+static struct hctx_sample hctx_samples[2];
+static struct hctx_sample *hctx_curr = &hctx_samples[0];
+static struct hctx_sample *hctx_prev = &hctx_samples[1];
+static int have_hctx_prev;
+
+/*
+ ***************************************************************************
+ * Find the snapshot to compute a window of @window_ms from.
+ *
+ * RETURNS:
+ * The newest snapshot at least @window_ms older than @now, else the
+ * oldest one, or NULL if the ring is empty.
+ ***************************************************************************
+ */
+static struct diskstats_snap *find_base(const struct diskstats_snap *now,
+					unsigned long long window_ms)
+{
+	struct diskstats_snap *ds = NULL;
+	int i;
+
+	for (i = 0; i < ring_nr; i++) {
+		ds = &ring[(ring_head - i + DISKSTAT_RING) % DISKSTAT_RING];
+		if (now->uptime_ms - ds->uptime_ms >= window_ms)
+			break;
+	}
+	return ds;
+}
+
+/*
+ ***************************************************************************
+ * Find device @d in snapshot @ds. Devices are almost always listed in the
+ * same order from one snapshot to the next, so entry @hint is tried first.
+ ***************************************************************************
+ */
+static struct diskstats_dev *find_dev(const struct diskstats_snap *ds,
+				      const struct diskstats_dev *d, int hint)
+{
+	struct diskstats_dev *p;
+	int i;
+
+	if ((hint < ds->nr_dev) && (ds->dev[hint].major == d->major) &&
+	    (ds->dev[hint].minor == d->minor))
+		return &ds->dev[hint];
+	for (i = 0, p = ds->dev; i < ds->nr_dev; i++, p++) {
+		if ((p->major == d->major) && (p->minor == d->minor))
+			return p;
+	}
+	return NULL;
+}
+
+/*
+ ***************************************************************************
+ * Keep @spare in the ring if the newest snapshot is old enough.
+ ***************************************************************************
+ */
+static void ring_push(void)
+{
+	struct diskstats_snap tmp;
+	int slot;
+
+	if ((ring_head >= 0) &&
+	    (spare.uptime_ms - ring[ring_head].uptime_ms < DISKSTAT_STEP_MS))
+		return;
+
+	/* Swap rather than copy: both keep their dev arrays */
+	slot = (ring_head + 1) % DISKSTAT_RING;
+	tmp = ring[slot];
+	ring[slot] = spare;
+	spare = tmp;
+	ring_head = slot;
+	if (ring_nr < DISKSTAT_RING)
+		ring_nr++;
+}
+
+/*
+ ***************************************************************************
+ * Tell if device @d is listed: devices with extended stats only, as
+ * "iostat -x", and some I/O since boot.
+ ***************************************************************************
+ */
+static int is_listed(struct diskstats_dev *d)
+{
+	return (d->nr_fields >= DISKSTATS_NR_FIELDS) &&
+	       (d->rd_ios || d->wr_ios) &&
+	       is_device(d->name, ACCEPT_VIRTUAL_DEVICES);
+}
+
+/*
+ ***************************************************************************
+ * Read the first numbers of a small sysfs or debugfs file.
+ *
+ * RETURNS:
+ * Number of values read, 0 if the file doesn't exist.
+ ***************************************************************************
+ */
+static int read_ull_file(const char *path, unsigned long long *v1,
+			 unsigned long long *v2)
+{
+	FILE *fp;
+	int n;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		return 0;
+	n = v2 ? fscanf(fp, "%llu %llu", v1, v2) : fscanf(fp, "%llu", v1);
+	fclose(fp);
+
+	return n < 0 ? 0 : n;
+}
+
+/*
+ ***************************************************************************
+ * Read the reads and writes in flight on device @name, which /proc/diskstats
+ * only gives as a sum.
+ ***************************************************************************
+ */
+static void read_inflight(const char *name, unsigned long long *rd,
+			  unsigned long long *wr)
+{
+	char path[MAX_PF_NAME];
+
+	*rd = *wr = 0;
+	snprintf(path, sizeof(path), "%s/%s/inflight", SYSFS_BLOCK, name);
+	read_ull_file(path, rd, wr);
+}
+
+/*
+ ***************************************************************************
+ * Read hardware queue @id of device @d.
+ *
+ * OUT:
+ * @h		Queue. Only the counters flagged in h->have are set.
+ *
+ * RETURNS:
+ * 0 on success, -1 if the device has no such queue.
+ ***************************************************************************
+ */
+static int read_hctx(const struct diskstats_dev *d, int id, struct hctx_stat *h)
+{
+	char path[MAX_PF_NAME], file[32], cpus[1024];
+	unsigned long long v, rd, wr;
+	char *p, *q;
+	FILE *fp;
+
+	h->major = d->major;
+	h->minor = d->minor;
+	h->id = id;
+	h->have = 0;
+
+	snprintf(path, sizeof(path), "%s/%s/mq/%d/nr_tags", SYSFS_BLOCK, d->name, id);
+	if (!read_ull_file(path, &v, NULL))
+		return -1;
+	h->nr_tags = v;
+
+	/* The kernel writes "0, 1, 2": drop the spaces to keep one column */
+	cpus[0] = '\0';
+	snprintf(path, sizeof(path), "%s/%s/mq/%d/cpu_list", SYSFS_BLOCK, d->name, id);
+	if ((fp = fopen(path, "r")) != NULL) {
+		if (fgets(cpus, sizeof(cpus), fp)) {
+			for (p = q = cpus; *p && (*p != '\n'); p++) {
+				if (*p != ' ')
+					*q++ = *p;
+			}
+			*q = '\0';
+		}
+		fclose(fp);
+	}
+	strncpy(h->cpus, cpus, HCTX_CPUS_LEN - 1);
+	h->cpus[HCTX_CPUS_LEN - 1] = '\0';
+
+#define HCTX_DEBUGFS(file)	\
+	snprintf(path, sizeof(path), "%s/%s/hctx%d/%s", DEBUGFS_BLOCK, d->name, id, file)
+	HCTX_DEBUGFS("run");
+	if (read_ull_file(path, &h->run, NULL))
+		h->have |= HCTX_RUN;
+	HCTX_DEBUGFS("queued");
+	if (read_ull_file(path, &h->queued, NULL))
+		h->have |= HCTX_QUEUED;
+
+	/* Completions are counted per software queue, one per CPU of the queue */
+	h->completed = 0;
+	for (p = cpus; *p; p = (*q == ',') ? q + 1 : q) {
+		v = strtoull(p, &q, 10);
+		if (q == p)
+			break;
+		snprintf(file, sizeof(file), "cpu%llu/completed", v);
+		HCTX_DEBUGFS(file);
+		if (read_ull_file(path, &rd, &wr) == 2) {
+			h->completed += rd + wr;
+			h->have |= HCTX_COMPLETED;
+		}
+	}
+#undef HCTX_DEBUGFS
+
+	return 0;
+}
+
+/*
+ ***************************************************************************
+ * Find the previous reading of hardware queue @h, trying entry @hint first.
+ ***************************************************************************
+ */
+static struct hctx_stat *find_hctx(const struct hctx_sample *s,
+				   const struct hctx_stat *h, int hint)
+{
+	struct hctx_stat *p;
+	int i;
+
+	for (i = 0; i < s->nr; i++) {
+		p = &s->hctx[(hint + i) % s->nr];
+		if ((p->major == h->major) && (p->minor == h->minor) &&
+		    (p->id == h->id))
+			return p;
+	}
+	return NULL;
+}
+
+/*
+ ***************************************************************************
+ * Print the rate of counter @flag of hardware queue @h, or "-".
+ ***************************************************************************
+ */
+static void print_hctx_rate(FILE *fp, const struct hctx_stat *h,
+			    const struct hctx_stat *p, unsigned int flag,
+			    unsigned long long cur, unsigned long long prev,
+			    unsigned long long itv_ms)
+{
+	if (!(h->have & flag)) {
+		fprintf(fp, " %9s", "-");
+		return;
+	}
+	/* Since boot if there is no previous reading or it was reset */
+	if (!p || !(p->have & flag) || (cur < prev))
+		prev = 0;
+	fprintf(fp, " %9.2f", (cur - prev) * 1000.0 / (itv_ms ? itv_ms : 1));
+}
+
+/*
+ ***************************************************************************
+ * Print the hardware queues of the devices listed from @ds, and keep them
+ * as the baseline of the next call.
+ ***************************************************************************
+ */
+static void print_hctx(FILE *fp, struct diskstats_snap *ds)
+{
+	struct hctx_sample *s = hctx_curr, *base;
+	struct hctx_stat *h, *p;
+	unsigned long long itv_ms;
+	int i, id, n;
+
+	s->uptime_ms = ds->uptime_ms;
+	s->nr = 0;
+	for (i = 0; i < ds->nr_dev; i++) {
+		if (!is_listed(&ds->dev[i]))
+			continue;
+		for (id = 0; ; id++) {
+			if (s->nr == s->alloc) {
+				n = s->alloc ? s->alloc * 2 : 16;
+				if ((h = realloc(s->hctx, n * sizeof(*h))) == NULL)
+					return;
+				s->hctx = h;
+				s->alloc = n;
+			}
+			h = &s->hctx[s->nr];
+			if (read_hctx(&ds->dev[i], id, h) < 0)
+				break;
+			h->dev = i;
+			s->nr++;
+		}
+	}
+
+	base = have_hctx_prev ? hctx_prev : NULL;
+	itv_ms = base ? s->uptime_ms - base->uptime_ms : s->uptime_ms;
+
+	fprintf(fp, "hctx_interval_ms %llu\n", itv_ms);
+	fprintf(fp, "Device:        hctx nr_tags cpus                   run/s  queued/s"
+		    "   compl/s\n");
+	for (i = 0, h = s->hctx; i < s->nr; i++, h++) {
+		p = base ? find_hctx(base, h, i) : NULL;
+		fprintf(fp, "%-13s %5d %7d %-20s", ds->dev[h->dev].name, h->id,
+			h->nr_tags, h->cpus[0] ? h->cpus : "-");
+		print_hctx_rate(fp, h, p, HCTX_RUN, h->run,
+				p ? p->run : 0, itv_ms);
+		print_hctx_rate(fp, h, p, HCTX_QUEUED, h->queued,
+				p ? p->queued : 0, itv_ms);
+		print_hctx_rate(fp, h, p, HCTX_COMPLETED, h->completed,
+				p ? p->completed : 0, itv_ms);
+		fputc('\n', fp);
+	}
+
+	hctx_curr = hctx_prev;
+	hctx_prev = s;
+	have_hctx_prev = 1;
+}
+
+/*
+ ***************************************************************************
+ * Main entry to the diskstat program.
+ ***************************************************************************
+ */
+int diskstat_main(int argc, char **argv, int fd)
+{
+	struct diskstats_snap *base;
+	struct diskstats_dev *d, *p;
+	struct diskstats_rates r;
+	unsigned long long window_ms = 1000, itv_ms, rd_infl, wr_infl;
+	int i, queues = FALSE;
+	FILE *fp;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-w") && (i + 1 < argc))
+			window_ms = atol(argv[++i]) * 1000ULL;
+		else if (!strcmp(argv[i], "-q"))
+			queues = TRUE;
+	}
+
+	if ((fp = fdopen(fd, "w")) == NULL)
+		return 1;
+
+	/* Ticks per second, for compute_ext_disk_stats() */
+	get_HZ();
+
+	if (read_diskstats_snap(&diskstats_file, &spare) < 0) {
+		fclose(fp);
+		return 1;
+	}
+
+	base = find_base(&spare, window_ms);
+	itv_ms = base ? spare.uptime_ms - base->uptime_ms : spare.uptime_ms;
+
+	fprintf(fp, "interval_ms %llu\n", itv_ms);
+	fprintf(fp, "Device:         rrqm/s   wrqm/s     r/s     w/s    rkB/s    wkB/s"
+		    " avgrq-sz avgqu-sz   await r_await w_await  svctm  %%util"
+		    "     d/s   drqm/s    dkB/s d_await     f/s f_await r_infl w_infl\n");
+
+	for (i = 0, d = spare.dev; i < spare.nr_dev; i++, d++) {
+		if (!is_listed(d))
+			continue;
+
+		p = base ? find_dev(base, d, i) : NULL;
+		compute_diskstats_rates(d, p, itv_ms, &r);
+		read_inflight(d->name, &rd_infl, &wr_infl);
+
+		fprintf(fp, "%-13s %8.2f %8.2f %7.2f %7.2f %8.2f %8.2f %8.2f %8.2f"
+			    " %7.2f %7.2f %7.2f %6.2f %6.2f"
+			    " %7.2f %8.2f %8.2f %7.2f %7.2f %7.2f %6llu %6llu\n",
+			d->name, r.rd_merges, r.wr_merges, r.rd_ios, r.wr_ios,
+			r.rd_kb, r.wr_kb, r.arqsz, r.aqu_sz,
+			r.await, r.r_await, r.w_await, r.svctm, r.util,
+			r.dc_ios, r.dc_merges, r.dc_kb, r.d_await,
+			r.fl_ios, r.f_await, rd_infl, wr_infl);
+	}
+
+	if (queues)
+		print_hctx(fp, &spare);
+	fclose(fp);
+
+	ring_push();
+
+	return 0;
+}
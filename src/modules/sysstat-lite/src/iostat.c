@@ -23,7 +23,6 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <signal.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <time.h>
@@ -54,6 +53,11 @@ static char *sccsid(void) { return (SCCSID); }
 struct stats_cpu *st_cpu_iostat[2];
 static unsigned long long uptime_iostat[2]  = {0, 0};
 static unsigned long long uptime_iostat0[2] = {0, 0};
+/* /proc/stat copy and /proc/uptime, kept across runs */
+static struct procstat stat_snap_iostat;
+static struct proc_file uptime_file_iostat = PROC_FILE_INIT(UPTIME);
+static struct proc_file diskstats_file_iostat = PROC_FILE_INIT(DISKSTATS);
+static struct diskstats_snap diskstats_iostat;
 struct io_stats *st_iodev_iostat[2];
 struct io_hdr_stats *st_hdr_iodev_iostat;
 struct io_dlist *st_dev_list_iostat;
@@ -118,19 +122,6 @@ void set_disk_output_unit(void)
 	}
 }
 
-/*
- ***************************************************************************
- * SIGALRM signal handler. No need to reset the handler here.
- *
- * IN:
- * @sig	Signal number.
- ***************************************************************************
- */
-static void alarm_handler(int sig)
-{
-	alarm(interval_iostat);
-}
-
 /*
  ***************************************************************************
  * Initialize stats common structures.
@@ -491,16 +482,20 @@ int read_sysfs_file_stat(int curr, char *filename, char *dev_name)
 	unsigned int ios_pgr, tot_ticks, rq_ticks, wr_ticks;
 	unsigned long rd_ios, rd_merges_or_rd_sec, wr_ios, wr_merges;
 	unsigned long rd_sec_or_wr_ios, wr_sec, rd_ticks_or_wr_sec;
+	unsigned long dc_ios = 0, dc_merges = 0, dc_sec = 0, fl_ios = 0;
+	unsigned int dc_ticks = 0, fl_ticks = 0;
 
 	/* Try to read given stat file */
 	if ((fp = fopen(filename, "r")) == NULL)
 		return 0;
 
-	i = fscanf(fp, "%lu %lu %lu %lu %lu %lu %lu %u %u %u %u",
+	/* Discard (4.18) and flush (5.5) counters follow on newer kernels */
+	i = fscanf(fp, "%lu %lu %lu %lu %lu %lu %lu %u %u %u %u %lu %lu %lu %u %lu %u",
 		   &rd_ios, &rd_merges_or_rd_sec, &rd_sec_or_wr_ios, &rd_ticks_or_wr_sec,
-		   &wr_ios, &wr_merges, &wr_sec, &wr_ticks, &ios_pgr, &tot_ticks, &rq_ticks);
+		   &wr_ios, &wr_merges, &wr_sec, &wr_ticks, &ios_pgr, &tot_ticks, &rq_ticks,
+		   &dc_ios, &dc_merges, &dc_sec, &dc_ticks, &fl_ios, &fl_ticks);
 
-	if (i == 11) {
+	if (i >= 11) {
 		/* Device or partition */
 		sdev.rd_ios     = rd_ios;
 		sdev.rd_merges  = rd_merges_or_rd_sec;
@@ -513,6 +508,12 @@ int read_sysfs_file_stat(int curr, char *filename, char *dev_name)
 		sdev.ios_pgr    = ios_pgr;
 		sdev.tot_ticks  = tot_ticks;
 		sdev.rq_ticks   = rq_ticks;
+		sdev.dc_ios     = dc_ios;
+		sdev.dc_merges  = dc_merges;
+		sdev.dc_sectors = dc_sec;
+		sdev.dc_ticks   = dc_ticks;
+		sdev.fl_ios     = fl_ios;
+		sdev.fl_ticks   = fl_ticks;
 	}
 	else if (i == 4) {
 		/* Partition without extended statistics */
@@ -522,7 +523,7 @@ int read_sysfs_file_stat(int curr, char *filename, char *dev_name)
 		sdev.wr_sectors = rd_ticks_or_wr_sec;
 	}
 
-	if ((i == 11) || !DISPLAY_EXTENDED(flags_iostat)) {
+	if ((i >= 11) || !DISPLAY_EXTENDED(flags_iostat)) {
 		/*
 		 * In fact, we _don't_ save stats if it's a partition without
 		 * extended stats and yet we want to display ext stats.
@@ -675,64 +676,59 @@ void read_sysfs_stat(int curr)
  */
 void read_diskstats_stat(int curr)
 {
-	FILE *fp;
-	char line[256], dev_name[MAX_NAME_LEN];
+	char dev_name[MAX_NAME_LEN];
 	char *dm_name;
 	struct io_stats sdev;
+	struct diskstats_dev *d;
 	int i;
-	unsigned int ios_pgr, tot_ticks, rq_ticks, wr_ticks;
-	unsigned long rd_ios, rd_merges_or_rd_sec, rd_ticks_or_wr_sec, wr_ios;
-	unsigned long wr_merges, rd_sec_or_wr_ios, wr_sec;
 	char *ioc_dname;
-	unsigned int major, minor;
 
 	/* Every I/O device entry is potentially unregistered */
 	set_entries_unregistered(iodev_nr_iostat, st_hdr_iodev_iostat);
 
-	if ((fp = fopen(DISKSTATS, "r")) == NULL)
+	if (read_diskstats_snap(&diskstats_file_iostat, &diskstats_iostat) < 0)
 		return;
 
-	while (fgets(line, sizeof(line), fp) != NULL) {
+	for (i = 0, d = diskstats_iostat.dev; i < diskstats_iostat.nr_dev; i++, d++) {
 
-		/* major minor name rio rmerge rsect ruse wio wmerge wsect wuse running use aveq */
-		i = sscanf(line, "%u %u %s %lu %lu %lu %lu %lu %lu %lu %u %u %u %u",
-			   &major, &minor, dev_name,
-			   &rd_ios, &rd_merges_or_rd_sec, &rd_sec_or_wr_ios, &rd_ticks_or_wr_sec,
-			   &wr_ios, &wr_merges, &wr_sec, &wr_ticks, &ios_pgr, &tot_ticks, &rq_ticks);
+		strcpy(dev_name, d->name);
 
-		if (i == 14) {
+		if (d->nr_fields >= DISKSTATS_NR_FIELDS) {
 			/* Device or partition */
 			if (!dlist_idx_iostat && !DISPLAY_PARTITIONS(flags_iostat) &&
 			    !is_device(dev_name, ACCEPT_VIRTUAL_DEVICES))
 				continue;
-			sdev.rd_ios     = rd_ios;
-			sdev.rd_merges  = rd_merges_or_rd_sec;
-			sdev.rd_sectors = rd_sec_or_wr_ios;
-			sdev.rd_ticks   = (unsigned int) rd_ticks_or_wr_sec;
-			sdev.wr_ios     = wr_ios;
-			sdev.wr_merges  = wr_merges;
-			sdev.wr_sectors = wr_sec;
-			sdev.wr_ticks   = wr_ticks;
-			sdev.ios_pgr    = ios_pgr;
-			sdev.tot_ticks  = tot_ticks;
-			sdev.rq_ticks   = rq_ticks;
+			sdev.rd_ios     = d->rd_ios;
+			sdev.rd_merges  = d->rd_merges;
+			sdev.rd_sectors = d->rd_sectors;
+			sdev.rd_ticks   = d->rd_ticks;
+			sdev.wr_ios     = d->wr_ios;
+			sdev.wr_merges  = d->wr_merges;
+			sdev.wr_sectors = d->wr_sectors;
+			sdev.wr_ticks   = d->wr_ticks;
+			sdev.ios_pgr    = d->ios_pgr;
+			sdev.tot_ticks  = d->tot_ticks;
+			sdev.rq_ticks   = d->rq_ticks;
+			sdev.dc_ios     = d->dc_ios;
+			sdev.dc_merges  = d->dc_merges;
+			sdev.dc_sectors = d->dc_sectors;
+			sdev.dc_ticks   = d->dc_ticks;
+			sdev.fl_ios     = d->fl_ios;
+			sdev.fl_ticks   = d->fl_ticks;
 		}
-		else if (i == 7) {
+		else {
 			/* Partition without extended statistics */
 			if (DISPLAY_EXTENDED(flags_iostat) ||
 			    (!dlist_idx_iostat && !DISPLAY_PARTITIONS(flags_iostat)))
 				continue;
 
-			sdev.rd_ios     = rd_ios;
-			sdev.rd_sectors = rd_merges_or_rd_sec;
-			sdev.wr_ios     = rd_sec_or_wr_ios;
-			sdev.wr_sectors = rd_ticks_or_wr_sec;
+			sdev.rd_ios     = d->rd_ios;
+			sdev.rd_sectors = d->rd_sectors;
+			sdev.wr_ios     = d->wr_ios;
+			sdev.wr_sectors = d->wr_sectors;
 		}
-		else
-			/* Unknown entry: Ignore it */
-			continue;
 
-		if ((ioc_dname = ioc_name(major, minor)) != NULL) {
+		if ((ioc_dname = ioc_name(d->major, d->minor)) != NULL) {
 			if (strcmp(dev_name, ioc_dname) && strcmp(ioc_dname, K_NODEV)) {
 				/*
 				 * No match: Use name generated from sysstat.ioconf data
@@ -744,12 +740,12 @@ void read_diskstats_stat(int curr)
 			}
 		}
 
-		if ((DISPLAY_DEVMAP_NAME(flags_iostat)) && (major == dm_major_iostat)) {
+		if ((DISPLAY_DEVMAP_NAME(flags_iostat)) && (d->major == dm_major_iostat)) {
 			/*
 			 * If the device is a device mapper device, try to get its
 			 * assigned name of its logical device.
 			 */
-			dm_name = transform_devmapname(major, minor);
+			dm_name = transform_devmapname(d->major, d->minor);
 			if (dm_name) {
 				strncpy(dev_name, dm_name, MAX_NAME_LEN - 1);
 				dev_name[MAX_NAME_LEN - 1] = '\0';
@@ -758,7 +754,6 @@ void read_diskstats_stat(int curr)
 
 		save_stats(dev_name, curr, &sdev, iodev_nr_iostat, st_hdr_iodev_iostat);
 	}
-	fclose(fp);
 
 	/* Free structures corresponding to unregistered devices */
 	free_unregistered_entries(iodev_nr_iostat, st_hdr_iodev_iostat);
@@ -802,6 +797,12 @@ void compute_device_groups_stats(int curr)
 			gdev.ios_pgr    += ioi->ios_pgr;
 			gdev.tot_ticks  += ioi->tot_ticks;
 			gdev.rq_ticks   += ioi->rq_ticks;
+			gdev.dc_ios     += ioi->dc_ios;
+			gdev.dc_merges  += ioi->dc_merges;
+			gdev.dc_sectors += ioi->dc_sectors;
+			gdev.dc_ticks   += ioi->dc_ticks;
+			gdev.fl_ios     += ioi->fl_ios;
+			gdev.fl_ticks   += ioi->fl_ticks;
 			nr_disks++;
 		}
 		else if (shi->status == DISK_GROUP) {
@@ -1060,7 +1061,9 @@ void write_json_ext_stat(int tab, unsigned long long itv, int fctr,
 		 "\"r\": %.2f, \"w\": %.2f, \"rkB\": %.2f, \"wkB\": %.2f, "
 		 "\"avgrq-sz\": %.2f, \"avgqu-sz\": %.2f, "
 		 "\"await\": %.2f, \"r_await\": %.2f, \"w_await\": %.2f, "
-		 "\"svctm\": %.2f, \"util\": %.2f}",
+		 "\"svctm\": %.2f, \"util\": %.2f, "
+		 "\"d\": %.2f, \"drqm\": %.2f, \"dkB\": %.2f, \"d_await\": %.2f, "
+		 "\"f\": %.2f, \"f_await\": %.2f}",
 		 devname,
 		 S_VALUE(ioj->rd_merges, ioi->rd_merges, itv),
 		 S_VALUE(ioj->wr_merges, ioi->wr_merges, itv),
@@ -1075,7 +1078,15 @@ void write_json_ext_stat(int tab, unsigned long long itv, int fctr,
 		 w_await,
 		 xds->svctm,
 		 shi->used ? xds->util / 10.0 / (double) shi->used
-			   : xds->util / 10.0);	/* shi->used should never be zero here */
+			   : xds->util / 10.0,	/* shi->used should never be zero here */
+		 S_VALUE(ioj->dc_ios, ioi->dc_ios, itv),
+		 S_VALUE(ioj->dc_merges, ioi->dc_merges, itv),
+		 S_VALUE(ioj->dc_sectors, ioi->dc_sectors, itv) / fctr,
+		 (ioi->dc_ios - ioj->dc_ios) ?
+		 (ioi->dc_ticks - ioj->dc_ticks) / ((double) (ioi->dc_ios - ioj->dc_ios)) : 0.0,
+		 S_VALUE(ioj->fl_ios, ioi->fl_ios, itv),
+		 (ioi->fl_ios - ioj->fl_ios) ?
+		 (ioi->fl_ticks - ioj->fl_ticks) / ((double) (ioi->fl_ios - ioj->fl_ios)) : 0.0);
 }
 
 /*
@@ -1459,6 +1470,7 @@ void rw_io_stat_loop(long int count, struct tm *rectime, FILE* fp)
 {
 	int curr = 1;
 	int skip = 0;
+	struct timespec next;
 
 	/* Should we skip first report? */
 	if (DISPLAY_OMIT_SINCE_BOOT(flags_iostat) && interval_iostat > 0) {
@@ -1468,6 +1480,8 @@ void rw_io_stat_loop(long int count, struct tm *rectime, FILE* fp)
 	/* Don't buffer data if redirected to a pipe */
 	setbuf(stdout, NULL);
 
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
 	do {
 		if (cpu_nr_iostat > 1) {
 			/*
@@ -1476,7 +1490,7 @@ void rw_io_stat_loop(long int count, struct tm *rectime, FILE* fp)
 			 * this will be done by /proc/stat.
 			 */
 			uptime_iostat0[curr] = 0;
-			read_uptime(&(uptime_iostat0[curr]));
+			read_uptime(&uptime_file_iostat, &(uptime_iostat0[curr]));
 		}
 
 		/*
@@ -1484,7 +1498,8 @@ void rw_io_stat_loop(long int count, struct tm *rectime, FILE* fp)
 		 * Note that stats for CPU 0 are not used per se. It only makes
 		 * read_stat_cpu() fill uptime_iostat0.
 		 */
-		read_stat_cpu(st_cpu_iostat[curr], 2, &(uptime_iostat[curr]), &(uptime_iostat0[curr]));
+		read_stat_snapshot(&stat_snap_iostat);
+		read_stat_cpu(&stat_snap_iostat, st_cpu_iostat[curr], 2, &(uptime_iostat[curr]), &(uptime_iostat0[curr]));
 
 		if (dlist_idx_iostat) {
 			/*
@@ -1541,7 +1556,13 @@ void rw_io_stat_loop(long int count, struct tm *rectime, FILE* fp)
 		}
 		if (count) {
 			curr ^= 1;
-			pause();
+			/*
+			 * No SIGALRM: this runs in a lepd worker thread. Sleep
+			 * until an absolute deadline so reports don't drift.
+			 */
+			next.tv_sec += interval_iostat;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &next, NULL) == EINTR);
 		}
 	}
 	while (count);
@@ -0,0 +1,312 @@
+/*
+ * irqstat.c: per-IRQ, per-CPU interrupt rates
+ *
+ * mpstat -I ALL samples /proc/interrupts, sleeps a second and samples it
+ * again.  irqstat keeps the previous sample instead, so each call reports
+ * the rates since the call before it and never sleeps.  The output is a
+ * matrix of numbers meant for programs:
+ *
+ *	interval_ms 1003
+ *	cpus 0 1 2 3
+ *	<irq> <total/s> <cpu0/s> <cpu1/s> ...
+ *
+ * Rows are sorted by total rate, IRQs that did not fire are left out, and
+ * "--top N" keeps the N busiest ones.
+ *
+ * Licensed under GPLv2 or later.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common.h"
+#include "rd_stats.h"
+
+#define IRQ_NAME_LEN	16
+
+/*
+ * A shorter interval than this is mostly noise: report the average since
+ * boot and keep the older baseline (the same rule as ps %CPU).
+ */
+#define IRQSTAT_MIN_INTERVAL_NS	250000000ULL
+
+struct irq_sample {
+	int nr_cpu;
+	size_t cpu_alloc;
+	int *cpu;			/* CPU number of each column */
+	int nr_irq;
+	size_t irq_alloc;
+	char (*name)[IRQ_NAME_LEN];
+	unsigned long long *count;	/* nr_irq rows of nr_cpu counts */
+	size_t count_alloc;
+	unsigned long long ns;		/* CLOCK_BOOTTIME when read */
+};
+
+struct irq_rate {
+	int irq;
+	double total;
+};
+
+static struct proc_file irq_file = PROC_FILE_INIT(INTERRUPTS);
+static struct irq_sample samples[2];
+static struct irq_sample *curr_sample = &samples[0], *prev_sample = &samples[1];
+static int have_prev;
+
+/* rates of the current call, reused across calls */
+static double *rates;
+static size_t rates_alloc;
+static struct irq_rate *order;
+static size_t order_alloc;
+
+static int grow(void **p, size_t *alloc, size_t nr, size_t size)
+{
+	void *q;
+	size_t n;
+
+	if (nr <= *alloc)
+		return 0;
+	n = nr < 64 ? 64 : nr * 2;
+	if ((q = realloc(*p, n * size)) == NULL)
+		return -1;
+	*p = q;
+	*alloc = n;
+	return 0;
+}
+
+/*
+ ***************************************************************************
+ * Read /proc/interrupts.
+ *
+ * OUT:
+ * @s		Sample. Its arrays only grow, so a steady state read does
+ *		no allocation.
+ *
+ * RETURNS:
+ * 0 on success, -1 on error.
+ ***************************************************************************
+ */
+static int read_irq_sample(struct irq_sample *s)
+{
+	unsigned long long v, *row;
+	struct timespec ts;
+	char *text, *line, *p, *colon;
+	size_t len;
+	int i;
+
+	if ((text = read_proc_file(&irq_file)) == NULL)
+		return -1;
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	s->ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	/* Header line: "CPU0 CPU1 ...", offline CPUs are not listed */
+	s->nr_cpu = 0;
+	for (p = text; *p && (*p != '\n'); ) {
+		while (*p == ' ')
+			p++;
+		if (!strncmp(p, "CPU", 3)) {
+			p += 3;
+			if (parse_proc_ull(&p, &v)) {
+				if (grow((void **) &s->cpu, &s->cpu_alloc,
+					 s->nr_cpu + 1, sizeof(*s->cpu)) < 0)
+					return -1;
+				s->cpu[s->nr_cpu++] = v;
+			}
+		}
+		p += strcspn(p, " \n");
+	}
+
+	/*
+	 * Then one line per IRQ: "<name>: <count per CPU> <description>".
+	 * A few (ERR, MIS) have a single count, the other columns are zeroed.
+	 */
+	s->nr_irq = 0;
+	for (line = next_proc_line(text); line; line = next_proc_line(line)) {
+		p = line;
+		while (*p == ' ')
+			p++;
+		colon = p + strcspn(p, ":\n");
+		if (*colon != ':')
+			continue;
+
+		if ((grow((void **) &s->name, &s->irq_alloc, s->nr_irq + 1,
+			  sizeof(*s->name)) < 0) ||
+		    (grow((void **) &s->count, &s->count_alloc,
+			  (size_t) (s->nr_irq + 1) * s->nr_cpu,
+			  sizeof(*s->count)) < 0))
+			return -1;
+
+		len = colon - p;
+		if (len >= IRQ_NAME_LEN)
+			len = IRQ_NAME_LEN - 1;
+		memcpy(s->name[s->nr_irq], p, len);
+		s->name[s->nr_irq][len] = '\0';
+
+		p = colon + 1;
+		row = s->count + (size_t) s->nr_irq * s->nr_cpu;
+		for (i = 0; (i < s->nr_cpu) && parse_proc_ull(&p, &row[i]); i++);
+		for (; i < s->nr_cpu; i++)
+			row[i] = 0;
+		s->nr_irq++;
+	}
+
+	return 0;
+}
+
+/*
+ ***************************************************************************
+ * Find the row of IRQ @name in sample @s. IRQs are almost always listed
+ * in the same order from one sample to the next, so row @hint is tried
+ * first.
+ *
+ * RETURNS:
+ * The row, or -1 if the IRQ is not in the sample.
+ ***************************************************************************
+ */
+static int find_irq(const struct irq_sample *s, const char *name, int hint)
+{
+	int i;
+
+	if ((hint < s->nr_irq) && !strcmp(s->name[hint], name))
+		return hint;
+	for (i = 0; i < s->nr_irq; i++) {
+		if (!strcmp(s->name[i], name))
+			return i;
+	}
+	return -1;
+}
+
+static int cmp_rate(const void *a, const void *b)
+{
+	const struct irq_rate *x = a, *y = b;
+
+	if (x->total != y->total)
+		return x->total < y->total ? 1 : -1;
+	return x->irq - y->irq;
+}
+
+/*
+ ***************************************************************************
+ * Compute the rates of the current sample, against the previous one if
+ * @base is set, else since boot.
+ *
+ * RETURNS:
+ * Number of IRQs that fired, sorted by decreasing rate in order[].
+ ***************************************************************************
+ */
+static int compute_rates(const struct irq_sample *s,
+			 const struct irq_sample *base)
+{
+	const unsigned long long *row, *prow;
+	unsigned long long ns;
+	double *r, total;
+	int irq, i, prev, nr = 0;
+
+	if ((grow((void **) &rates, &rates_alloc,
+		  (size_t) s->nr_irq * s->nr_cpu, sizeof(*rates)) < 0) ||
+	    (grow((void **) &order, &order_alloc, s->nr_irq,
+		  sizeof(*order)) < 0))
+		return -1;
+
+	ns = base ? s->ns - base->ns : s->ns;
+	if (!ns)
+		ns = 1;
+
+	for (irq = 0; irq < s->nr_irq; irq++) {
+		row = s->count + (size_t) irq * s->nr_cpu;
+		r = rates + (size_t) irq * s->nr_cpu;
+		prev = base ? find_irq(base, s->name[irq], irq) : -1;
+		prow = (prev >= 0) ? base->count + (size_t) prev * s->nr_cpu : NULL;
+
+		total = 0;
+		for (i = 0; i < s->nr_cpu; i++) {
+			if (!prow)
+				r[i] = row[i];
+			else if (row[i] >= prow[i])
+				r[i] = row[i] - prow[i];
+			else
+				/* Counter reset: IRQ freed and requested again */
+				r[i] = row[i];
+			r[i] = r[i] * 1e9 / ns;
+			total += r[i];
+		}
+		if (total >= 0.5) {
+			order[nr].irq = irq;
+			order[nr].total = total;
+			nr++;
+		}
+	}
+	qsort(order, nr, sizeof(*order), cmp_rate);
+
+	return nr;
+}
+
+/*
+ ***************************************************************************
+ * Main entry to the irqstat program.
+ ***************************************************************************
+ */
+int irqstat_main(int argc, char **argv, int fd)
+{
+	struct irq_sample *s, *base = NULL;
+	const double *r;
+	long top = 0;
+	int same_cpus, nr, i, j;
+	FILE *fp;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--top") && (i + 1 < argc))
+			top = atol(argv[++i]);
+	}
+
+	if ((fp = fdopen(fd, "w")) == NULL)
+		return 1;
+
+	s = curr_sample;
+	if (read_irq_sample(s) < 0) {
+		fclose(fp);
+		return 1;
+	}
+
+	/* A CPU coming online or going offline changes the columns */
+	same_cpus = have_prev && (prev_sample->nr_cpu == s->nr_cpu) &&
+		    !memcmp(prev_sample->cpu, s->cpu, s->nr_cpu * sizeof(*s->cpu));
+	if (same_cpus && (s->ns - prev_sample->ns >= IRQSTAT_MIN_INTERVAL_NS)) {
+		base = prev_sample;
+	}
+
+	if ((nr = compute_rates(s, base)) < 0) {
+		fclose(fp);
+		return 1;
+	}
+	if ((top > 0) && (nr > top))
+		nr = top;
+
+	fprintf(fp, "interval_ms %llu\n",
+		(base ? s->ns - base->ns : s->ns) / 1000000ULL);
+	fprintf(fp, "cpus");
+	for (i = 0; i < s->nr_cpu; i++)
+		fprintf(fp, " %d", s->cpu[i]);
+	fputc('\n', fp);
+	for (j = 0; j < nr; j++) {
+		r = rates + (size_t) order[j].irq * s->nr_cpu;
+		fprintf(fp, "%s %.0f", s->name[order[j].irq], order[j].total);
+		for (i = 0; i < s->nr_cpu; i++)
+			fprintf(fp, " %.0f", r[i]);
+		fputc('\n', fp);
+	}
+	fclose(fp);
+
+	/*
+	 * This sample is the baseline of the next call, unless it is too
+	 * close to the current baseline.
+	 */
+	if (base || !same_cpus) {
+		curr_sample = prev_sample;
+		prev_sample = s;
+		have_prev = 1;
+	}
+
+	return 0;
+}
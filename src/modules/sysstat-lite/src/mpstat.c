@@ -48,6 +48,10 @@ static char *sccsid(void) { return (SCCSID); }
 static unsigned long long uptime[3] = {0, 0, 0};
 static unsigned long long uptime0[3] = {0, 0, 0};
 
+/* /proc/stat copy and /proc/uptime, kept across runs */
+static struct procstat stat_snap;
+static struct proc_file uptime_file = PROC_FILE_INIT(UPTIME);
+
 /* NOTE: Use array of _char_ for bitmaps to avoid endianness problems...*/
 unsigned char *cpu_bitmap;	/* Bit 0: Global; Bit 1: 1st proc; etc. */
 
@@ -1373,16 +1377,17 @@ void rw_mpstat_loop(int dis_hdr, int rows, FILE* fp)
 		 * this will be done by /proc/stat.
 		 */
 		uptime0[0] = 0;
-		read_uptime(&(uptime0[0]));
+		read_uptime(&uptime_file, &(uptime0[0]));
 	}
-	read_stat_cpu(st_cpu[0], cpu_nr + 1, &(uptime[0]), &(uptime0[0]));
+	read_stat_snapshot(&stat_snap);
+	read_stat_cpu(&stat_snap, st_cpu[0], cpu_nr + 1, &(uptime[0]), &(uptime0[0]));
 
 	/*
 	 * Read total number of interrupts received among all CPU.
 	 * (this is the first value on the line "intr:" in the /proc/stat file).
 	 */
 	if (DISPLAY_IRQ_SUM(actflags)) {
-		read_stat_irq(st_irq[0], 1);
+		read_stat_irq(&stat_snap, st_irq[0]);
 	}
 
 	/*
@@ -1457,13 +1462,14 @@ void rw_mpstat_loop(int dis_hdr, int rows, FILE* fp)
 		/* Read uptime and CPU stats */
 		if (cpu_nr > 1) {
 			uptime0[curr] = 0;
-			read_uptime(&(uptime0[curr]));
+			read_uptime(&uptime_file, &(uptime0[curr]));
 		}
-		read_stat_cpu(st_cpu[curr], cpu_nr + 1, &(uptime[curr]), &(uptime0[curr]));
+		read_stat_snapshot(&stat_snap);
+		read_stat_cpu(&stat_snap, st_cpu[curr], cpu_nr + 1, &(uptime[curr]), &(uptime0[curr]));
 
 		/* Read total number of interrupts received among all CPU */
 		if (DISPLAY_IRQ_SUM(actflags)) {
-			read_stat_irq(st_irq[curr], 1);
+			read_stat_irq(&stat_snap, st_irq[curr]);
 		}
 
 		/*
@@ -0,0 +1,245 @@
+/*
+ * procstat.c: /proc/stat snapshot shared by all its readers
+ *
+ * On large machines generating /proc/stat is expensive for the kernel,
+ * and mpstat, iostat, top, irq_info and GetProcStat all want it, often
+ * within the same tick.  The file is read at most once per clock tick
+ * and parsed once; readers copy the parsed snapshot out.
+ *
+ * Licensed under GPLv2 or later.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "rd_stats.h"
+#include "procstat.h"
+
+static pthread_mutex_t procstat_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct proc_file stat_file = PROC_FILE_INIT(STAT);
+static struct procstat snap;
+static unsigned long long snap_ns;	/* when snap was read, 0 if never */
+
+/*
+ ***************************************************************************
+ * Make room for @nr entries in @ps->cpu.
+ *
+ * RETURNS:
+ * 0 on success, -1 if out of memory.
+ ***************************************************************************
+ */
+static int procstat_grow(struct procstat *ps, int nr)
+{
+	struct procstat_cpu *cpu;
+	int n;
+
+	if (nr <= ps->cpu_alloc)
+		return 0;
+	n = nr < 64 ? 64 : nr * 2;
+	if ((cpu = realloc(ps->cpu, n * sizeof(*cpu))) == NULL)
+		return -1;
+	ps->cpu = cpu;
+	ps->cpu_alloc = n;
+	return 0;
+}
+
+/*
+ ***************************************************************************
+ * Parse /proc/stat into snap.
+ *
+ * IN:
+ * @text	Contents of /proc/stat.
+ *
+ * RETURNS:
+ * 0 on success, -1 if out of memory.
+ ***************************************************************************
+ */
+static int procstat_parse(char *text)
+{
+	static const struct {
+		char name[16];
+		size_t offset;
+	} fields[] = {
+#define STAT_FIELD(name, member) { name, offsetof(struct procstat, member) }
+		STAT_FIELD("intr",		intr),
+		STAT_FIELD("ctxt",		ctxt),
+		STAT_FIELD("btime",		btime),
+		STAT_FIELD("processes",		processes),
+		STAT_FIELD("procs_running",	procs_running),
+		STAT_FIELD("procs_blocked",	procs_blocked),
+		STAT_FIELD("softirq",		softirq),
+#undef STAT_FIELD
+	};
+	struct procstat_cpu *c;
+	unsigned long long id;
+	char *line, *p;
+	size_t len;
+	int i;
+
+	if (procstat_grow(&snap, 1) < 0)
+		return -1;
+	snap.nr_cpu = 0;
+
+	for (line = text; line; line = next_proc_line(line)) {
+
+		if (!strncmp(line, "cpu", 3)) {
+			p = line + 3;
+			if (*p == ' ') {
+				c = &snap.cpu[0];
+			}
+			else {
+				if (!parse_proc_ull(&p, &id) || (id >= NR_CPUS))
+					continue;
+				if (procstat_grow(&snap, id + 2) < 0)
+					return -1;
+				if ((int) id >= snap.nr_cpu) {
+					/* CPUs missing from the file are offline */
+					memset(&snap.cpu[snap.nr_cpu + 1], 0,
+					       (id - snap.nr_cpu) * sizeof(*c));
+					snap.nr_cpu = id + 1;
+				}
+				c = &snap.cpu[id + 1];
+			}
+			/* All the fields don't necessarily exist */
+			memset(c, 0, sizeof(*c));
+			for (i = 0; (i < (int) (sizeof(*c) / sizeof(c->user))) &&
+			     parse_proc_ull(&p, &c->user + i); i++);
+			continue;
+		}
+
+		/* "name value ...": only the first value is kept */
+		len = strcspn(line, " \n");
+		if (len >= sizeof(fields[0].name))
+			continue;
+		for (i = 0; i < (int) (sizeof(fields) / sizeof(fields[0])); i++) {
+			if (!strncmp(line, fields[i].name, len) && !fields[i].name[len]) {
+				p = line + len;
+				parse_proc_ull(&p, (unsigned long long *)
+					       ((char *) &snap + fields[i].offset));
+				break;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ ***************************************************************************
+ * Read /proc/stat again if the snapshot is older than a clock tick, the
+ * resolution of its counters. Called with procstat_lock held.
+ *
+ * RETURNS:
+ * 0 on success, -1 if the file cannot be read.
+ ***************************************************************************
+ */
+static int procstat_refresh(void)
+{
+	static unsigned long long tick_ns;
+	unsigned long long now;
+	struct timespec ts;
+	char *text;
+
+	if (!tick_ns)
+		tick_ns = 1000000000ULL / sysconf(_SC_CLK_TCK);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	if (snap_ns && (now - snap_ns < tick_ns))
+		return 0;
+
+	if ((text = read_proc_file(&stat_file)) == NULL)
+		return -1;
+	/* parsing changes nothing in text; stat_file.buf stays the raw file */
+	if (procstat_parse(text) < 0)
+		return -1;
+	snap_ns = now;
+
+	return 0;
+}
+
+/*
+ ***************************************************************************
+ * Copy the current /proc/stat snapshot.
+ *
+ * IN:
+ * @ps		Structure owned by the caller. Its cpu[] array is grown as
+ *		needed and reused on the next call (see procstat_free()).
+ *
+ * OUT:
+ * @ps		Parsed /proc/stat.
+ *
+ * RETURNS:
+ * 0 on success, -1 on error.
+ ***************************************************************************
+ */
+int procstat_get(struct procstat *ps)
+{
+	struct procstat_cpu *cpu;
+	int cpu_alloc, rc = -1;
+
+	pthread_mutex_lock(&procstat_lock);
+	if ((procstat_refresh() == 0) &&
+	    (procstat_grow(ps, snap.nr_cpu + 1) == 0)) {
+		cpu = ps->cpu;
+		cpu_alloc = ps->cpu_alloc;
+		*ps = snap;
+		ps->cpu = cpu;
+		ps->cpu_alloc = cpu_alloc;
+		memcpy(cpu, snap.cpu, (snap.nr_cpu + 1) * sizeof(*cpu));
+		rc = 0;
+	}
+	pthread_mutex_unlock(&procstat_lock);
+
+	return rc;
+}
+
+/*
+ ***************************************************************************
+ * Copy the text of the current /proc/stat snapshot.
+ *
+ * IN:
+ * @buf		Buffer where the text will be saved.
+ * @size	Size of @buf. The text is truncated to fit.
+ *
+ * RETURNS:
+ * Length of the text saved, or -1 on error.
+ ***************************************************************************
+ */
+ssize_t procstat_text(char *buf, size_t size)
+{
+	ssize_t len = -1;
+
+	if (!size)
+		return -1;
+
+	pthread_mutex_lock(&procstat_lock);
+	if (procstat_refresh() == 0) {
+		len = strlen(stat_file.buf);
+		if ((size_t) len >= size)
+			len = size - 1;
+		memcpy(buf, stat_file.buf, len);
+		buf[len] = '\0';
+	}
+	pthread_mutex_unlock(&procstat_lock);
+
+	return len;
+}
+
+/*
+ ***************************************************************************
+ * Free the cpu[] array of a snapshot copy.
+ ***************************************************************************
+ */
+void procstat_free(struct procstat *ps)
+{
+	free(ps->cpu);
+	ps->cpu = NULL;
+	ps->nr_cpu = ps->cpu_alloc = 0;
+}
@@ -22,13 +22,16 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "common.h"
 #include "rd_stats.h"
@@ -42,11 +45,172 @@
 #define _(string) (string)
 #endif
 
+/*
+ ***************************************************************************
+ * Read a whole /proc file. The file is opened on first use and then
+ * re-read with pread() at offset 0 into a buffer which only grows, to the
+ * largest size seen: sampling the same file again neither opens it nor
+ * allocates.
+ *
+ * IN:
+ * @pf		File to read, owned by the caller (see PROC_FILE_INIT).
+ *
+ * OUT:
+ * @pf		Buffer holding the contents, NUL-terminated.
+ *
+ * RETURNS:
+ * Contents of the file, or NULL if it cannot be read.
+ ***************************************************************************
+ */
+char *read_proc_file(struct proc_file *pf)
+{
+	ssize_t n;
+	char *buf;
+
+	if ((pf->fd < 0) &&
+	    ((pf->fd = open(pf->path, O_RDONLY | O_CLOEXEC)) < 0))
+		return NULL;
+
+	if (!pf->buf) {
+		pf->size = 4096;
+		if ((pf->buf = malloc(pf->size + 1)) == NULL)
+			return NULL;
+	}
+
+	/* A full buffer may mean a truncated file: grow it and read again */
+	while ((n = pread(pf->fd, pf->buf, pf->size, 0)) == (ssize_t) pf->size) {
+		if ((buf = realloc(pf->buf, pf->size * 2 + 1)) == NULL)
+			break;
+		pf->buf = buf;
+		pf->size *= 2;
+	}
+	if (n < 0) {
+		close(pf->fd);
+		pf->fd = -1;
+		return NULL;
+	}
+	pf->buf[n] = '\0';
+
+	return pf->buf;
+}
+
+/*
+ ***************************************************************************
+ * Close a file opened by read_proc_file() and free its buffer.
+ *
+ * IN:
+ * @pf		File to close.
+ ***************************************************************************
+ */
+void close_proc_file(struct proc_file *pf)
+{
+	if (pf->fd >= 0) {
+		close(pf->fd);
+		pf->fd = -1;
+	}
+	free(pf->buf);
+	pf->buf = NULL;
+	pf->size = 0;
+}
+
+/*
+ ***************************************************************************
+ * Parse an unsigned decimal number, skipping leading blanks (but not
+ * newlines: a missing field at the end of a line is not taken from the
+ * next one).
+ *
+ * IN:
+ * @p		Pointer to the text to parse.
+ *
+ * OUT:
+ * @p		Pointer to the character following the number.
+ * @value	Number read. Unchanged if there was none.
+ *
+ * RETURNS:
+ * 1 if a number was read, 0 otherwise.
+ ***************************************************************************
+ */
+int parse_proc_ull(char **p, unsigned long long *value)
+{
+	char *s = *p;
+	unsigned long long v = 0;
+
+	while ((*s == ' ') || (*s == '\t'))
+		s++;
+	if ((*s < '0') || (*s > '9'))
+		return 0;
+	do {
+		v = v * 10 + (*s++ - '0');
+	}
+	while ((*s >= '0') && (*s <= '9'));
+
+	*p = s;
+	*value = v;
+	return 1;
+}
+
+/*
+ ***************************************************************************
+ * Return the line following @line, or NULL if @line is the last one.
+ ***************************************************************************
+ */
+char *next_proc_line(char *line)
+{
+	char *nl = strchr(line, '\n');
+
+	return (nl && nl[1]) ? nl + 1 : NULL;
+}
+
+/*
+ ***************************************************************************
+ * Copy the jiffies of a /proc/stat "cpu" line.
+ *
+ * IN:
+ * @c		Line from a /proc/stat snapshot.
+ *
+ * OUT:
+ * @sc		Structure with statistics.
+ ***************************************************************************
+ */
+static void copy_cpu_jiffies(struct stats_cpu *sc, const struct procstat_cpu *c)
+{
+	sc->cpu_user       = c->user;
+	sc->cpu_nice       = c->nice;
+	sc->cpu_sys        = c->system;
+	sc->cpu_idle       = c->idle;
+	sc->cpu_iowait     = c->iowait;
+	sc->cpu_hardirq    = c->irq;
+	sc->cpu_softirq    = c->softirq;
+	sc->cpu_steal      = c->steal;
+	sc->cpu_guest      = c->guest;
+	sc->cpu_guest_nice = c->guest_nice;
+}
+
+/*
+ ***************************************************************************
+ * Take a snapshot of /proc/stat for read_stat_cpu() and read_stat_irq().
+ *
+ * IN:
+ * @ps		Snapshot owned by the caller (see procstat_get()).
+ *
+ * OUT:
+ * @ps		Current /proc/stat.
+ ***************************************************************************
+ */
+void read_stat_snapshot(struct procstat *ps)
+{
+	if (procstat_get(ps) < 0) {
+		fprintf(stderr, _("Cannot open %s: %s\n"), STAT, strerror(errno));
+		exit(2);
+	}
+}
+
 /*
  ***************************************************************************
  * Read CPU statistics and machine uptime.
  *
  * IN:
+ * @ps		/proc/stat snapshot (see procstat_get()).
  * @st_cpu	Structure where stats will be saved.
  * @nbr		Total number of CPU (including cpu "all").
  *
@@ -56,110 +220,65 @@
  * @uptime0	Machine uptime. Filled only if previously set to zero.
  ***************************************************************************
  */
-void read_stat_cpu(struct stats_cpu *st_cpu, int nbr,
+void read_stat_cpu(const struct procstat *ps, struct stats_cpu *st_cpu, int nbr,
 		   unsigned long long *uptime, unsigned long long *uptime0)
 {
-	FILE *fp;
-	struct stats_cpu *st_cpu_i;
 	struct stats_cpu sc;
-	char line[8192];
 	int proc_nb;
 
-	if ((fp = fopen(STAT, "r")) == NULL) {
-		fprintf(stderr, _("Cannot open %s: %s\n"), STAT, strerror(errno));
-		exit(2);
-	}
+	/*
+	 * Read the number of jiffies spent in the different modes
+	 * (user, nice, etc.) among all proc. CPU usage is not reduced
+	 * to one processor to avoid rounding problems.
+	 */
+	copy_cpu_jiffies(st_cpu, &ps->cpu[0]);
 
-	while (fgets(line, sizeof(line), fp) != NULL) {
+	/*
+	 * Compute the uptime of the system in jiffies (1/100ths of a second
+	 * if HZ=100).
+	 * Machine uptime is multiplied by the number of processors here.
+	 *
+	 * NB: Don't add cpu_guest/cpu_guest_nice because cpu_user/cpu_nice
+	 * already include them.
+	 */
+	*uptime = st_cpu->cpu_user + st_cpu->cpu_nice    +
+		st_cpu->cpu_sys    + st_cpu->cpu_idle    +
+		st_cpu->cpu_iowait + st_cpu->cpu_hardirq +
+		st_cpu->cpu_steal  + st_cpu->cpu_softirq;
 
-		if (!strncmp(line, "cpu ", 4)) {
+	if (nbr <= 1)
+		return;
 
-			/*
-			 * All the fields don't necessarily exist,
-			 * depending on the kernel version used.
-			 */
-			memset(st_cpu, 0, STATS_CPU_SIZE);
+	for (proc_nb = 0; proc_nb < ps->nr_cpu; proc_nb++) {
+		/*
+		 * Read the number of jiffies spent in the different modes
+		 * (user, nice, etc) for current proc.
+		 * This is done only on SMP machines.
+		 */
+		copy_cpu_jiffies(&sc, &ps->cpu[proc_nb + 1]);
 
-			/*
-			 * Read the number of jiffies spent in the different modes
-			 * (user, nice, etc.) among all proc. CPU usage is not reduced
-			 * to one processor to avoid rounding problems.
-			 */
-			sscanf(line + 5, "%llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
-			       &st_cpu->cpu_user,
-			       &st_cpu->cpu_nice,
-			       &st_cpu->cpu_sys,
-			       &st_cpu->cpu_idle,
-			       &st_cpu->cpu_iowait,
-			       &st_cpu->cpu_hardirq,
-			       &st_cpu->cpu_softirq,
-			       &st_cpu->cpu_steal,
-			       &st_cpu->cpu_guest,
-			       &st_cpu->cpu_guest_nice);
+		if (proc_nb < (nbr - 1)) {
+			st_cpu[proc_nb + 1] = sc;
+		}
+		/*
+		 * else additional CPUs have been dynamically registered
+		 * in /proc/stat.
+		 */
 
+		if (!proc_nb && !*uptime0) {
 			/*
-			 * Compute the uptime of the system in jiffies (1/100ths of a second
-			 * if HZ=100).
-			 * Machine uptime is multiplied by the number of processors here.
+			 * Compute uptime reduced to one proc using proc#0.
+			 * Done if /proc/uptime was unavailable.
 			 *
 			 * NB: Don't add cpu_guest/cpu_guest_nice because cpu_user/cpu_nice
 			 * already include them.
 			 */
-			*uptime = st_cpu->cpu_user + st_cpu->cpu_nice    +
-				st_cpu->cpu_sys    + st_cpu->cpu_idle    +
-				st_cpu->cpu_iowait + st_cpu->cpu_hardirq +
-				st_cpu->cpu_steal  + st_cpu->cpu_softirq;
-		}
-
-		else if (!strncmp(line, "cpu", 3)) {
-			if (nbr > 1) {
-				/* All the fields don't necessarily exist */
-				memset(&sc, 0, STATS_CPU_SIZE);
-				/*
-				 * Read the number of jiffies spent in the different modes
-				 * (user, nice, etc) for current proc.
-				 * This is done only on SMP machines.
-				 */
-				sscanf(line + 3, "%d %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
-				       &proc_nb,
-				       &sc.cpu_user,
-				       &sc.cpu_nice,
-				       &sc.cpu_sys,
-				       &sc.cpu_idle,
-				       &sc.cpu_iowait,
-				       &sc.cpu_hardirq,
-				       &sc.cpu_softirq,
-				       &sc.cpu_steal,
-				       &sc.cpu_guest,
-				       &sc.cpu_guest_nice);
-
-				if (proc_nb < (nbr - 1)) {
-					st_cpu_i = st_cpu + proc_nb + 1;
-					*st_cpu_i = sc;
-				}
-				/*
-				 * else additional CPUs have been dynamically registered
-				 * in /proc/stat.
-				 */
-
-				if (!proc_nb && !*uptime0) {
-					/*
-					 * Compute uptime reduced to one proc using proc#0.
-					 * Done if /proc/uptime was unavailable.
-					 *
-					 * NB: Don't add cpu_guest/cpu_guest_nice because cpu_user/cpu_nice
-					 * already include them.
-					 */
-					*uptime0 = sc.cpu_user + sc.cpu_nice  +
-						sc.cpu_sys     + sc.cpu_idle  +
-						sc.cpu_iowait  + sc.cpu_steal +
-						sc.cpu_hardirq + sc.cpu_softirq;
-				}
-			}
+			*uptime0 = sc.cpu_user + sc.cpu_nice  +
+				sc.cpu_sys     + sc.cpu_idle  +
+				sc.cpu_iowait  + sc.cpu_steal +
+				sc.cpu_hardirq + sc.cpu_softirq;
 		}
 	}
-
-	fclose(fp);
 }
 
 /*
@@ -167,40 +286,17 @@ void read_stat_cpu(struct stats_cpu *st_cpu, int nbr,
  * Read interrupts statistics from /proc/stat.
  *
  * IN:
+ * @ps		/proc/stat snapshot (see procstat_get()).
  * @st_irq	Structure where stats will be saved.
- * @nbr		Number of interrupts to read, including the total number
- *		of interrupts.
  *
  * OUT:
- * @st_irq	Structure with statistics.
+ * @st_irq	Structure with the total number of interrupts received
+ *		since system boot.
  ***************************************************************************
  */
-void read_stat_irq(struct stats_irq *st_irq, int nbr)
+void read_stat_irq(const struct procstat *ps, struct stats_irq *st_irq)
 {
-	FILE *fp;
-	struct stats_irq *st_irq_i;
-	char line[8192];
-	int i, pos;
-
-	if ((fp = fopen(STAT, "r")) == NULL)
-		return;
-
-	while (fgets(line, sizeof(line), fp) != NULL) {
-
-		if (!strncmp(line, "intr ", 5)) {
-			/* Read total number of interrupts received since system boot */
-			sscanf(line + 5, "%llu", &st_irq->irq_nr);
-			pos = strcspn(line + 5, " ") + 5;
-
-			for (i = 1; i < nbr; i++) {
-				st_irq_i = st_irq + i;
-				sscanf(line + pos, " %llu", &st_irq_i->irq_nr);
-				pos += strcspn(line + pos + 1, " ") + 1;
-			}
-		}
-	}
-
-	fclose(fp);
+	st_irq->irq_nr = ps->intr;
 }
 
 /*
@@ -208,119 +304,296 @@ void read_stat_irq(struct stats_irq *st_irq, int nbr)
  * Read memory statistics from /proc/meminfo.
  *
  * IN:
+ * @pf		/proc/meminfo file.
  * @st_memory	Structure where stats will be saved.
  *
  * OUT:
  * @st_memory	Structure with statistics.
  ***************************************************************************
  */
-void read_meminfo(struct stats_memory *st_memory)
+void read_meminfo(struct proc_file *pf, struct stats_memory *st_memory)
 {
-	FILE *fp;
-	char line[128];
-
-	if ((fp = fopen(MEMINFO, "r")) == NULL)
+	static const struct {
+		char name[16];
+		size_t offset;
+	} fields[] = {
+#define MEMINFO_FIELD(name, member) { name, offsetof(struct stats_memory, member) }
+		MEMINFO_FIELD("MemTotal",	tlmkb),		/* total amount of memory */
+		MEMINFO_FIELD("MemFree",	frmkb),		/* free memory */
+		MEMINFO_FIELD("Buffers",	bufkb),		/* buffered memory */
+		MEMINFO_FIELD("Cached",		camkb),		/* cached memory */
+		MEMINFO_FIELD("SwapCached",	caskb),		/* cached swap */
+		MEMINFO_FIELD("Active",		activekb),	/* active memory */
+		MEMINFO_FIELD("Inactive",	inactkb),	/* inactive memory */
+		MEMINFO_FIELD("SwapTotal",	tlskb),		/* total amount of swap memory */
+		MEMINFO_FIELD("SwapFree",	frskb),		/* free swap memory */
+		MEMINFO_FIELD("Dirty",		dirtykb),	/* dirty memory */
+		MEMINFO_FIELD("Committed_AS",	comkb),		/* commited memory */
+		MEMINFO_FIELD("AnonPages",	anonpgkb),	/* pages mapped into userspace page tables */
+		MEMINFO_FIELD("Slab",		slabkb),	/* in-kernel data structures cache */
+		MEMINFO_FIELD("KernelStack",	kstackkb),	/* kernel stack utilization */
+		MEMINFO_FIELD("PageTables",	pgtblkb),	/* lowest level of page tables */
+		MEMINFO_FIELD("VmallocUsed",	vmusedkb),	/* vmalloc area which is used */
+#undef MEMINFO_FIELD
+	};
+	unsigned long long v;
+	char *line, *p;
+	size_t len;
+	int i;
+
+	if ((line = read_proc_file(pf)) == NULL)
 		return;
 
-	while (fgets(line, sizeof(line), fp) != NULL) {
+	for (; line; line = next_proc_line(line)) {
 
-		if (!strncmp(line, "MemTotal:", 9)) {
-			/* Read the total amount of memory in kB */
-			sscanf(line + 9, "%lu", &st_memory->tlmkb);
-		}
-		else if (!strncmp(line, "MemFree:", 8)) {
-			/* Read the amount of free memory in kB */
-			sscanf(line + 8, "%lu", &st_memory->frmkb);
-		}
-		else if (!strncmp(line, "Buffers:", 8)) {
-			/* Read the amount of buffered memory in kB */
-			sscanf(line + 8, "%lu", &st_memory->bufkb);
-		}
-		else if (!strncmp(line, "Cached:", 7)) {
-			/* Read the amount of cached memory in kB */
-			sscanf(line + 7, "%lu", &st_memory->camkb);
-		}
-		else if (!strncmp(line, "SwapCached:", 11)) {
-			/* Read the amount of cached swap in kB */
-			sscanf(line + 11, "%lu", &st_memory->caskb);
-		}
-		else if (!strncmp(line, "Active:", 7)) {
-			/* Read the amount of active memory in kB */
-			sscanf(line + 7, "%lu", &st_memory->activekb);
-		}
-		else if (!strncmp(line, "Inactive:", 9)) {
-			/* Read the amount of inactive memory in kB */
-			sscanf(line + 9, "%lu", &st_memory->inactkb);
-		}
-		else if (!strncmp(line, "SwapTotal:", 10)) {
-			/* Read the total amount of swap memory in kB */
-			sscanf(line + 10, "%lu", &st_memory->tlskb);
-		}
-		else if (!strncmp(line, "SwapFree:", 9)) {
-			/* Read the amount of free swap memory in kB */
-			sscanf(line + 9, "%lu", &st_memory->frskb);
-		}
-		else if (!strncmp(line, "Dirty:", 6)) {
-			/* Read the amount of dirty memory in kB */
-			sscanf(line + 6, "%lu", &st_memory->dirtykb);
-		}
-		else if (!strncmp(line, "Committed_AS:", 13)) {
-			/* Read the amount of commited memory in kB */
-			sscanf(line + 13, "%lu", &st_memory->comkb);
-		}
-		else if (!strncmp(line, "AnonPages:", 10)) {
-			/* Read the amount of pages mapped into userspace page tables in kB */
-			sscanf(line + 10, "%lu", &st_memory->anonpgkb);
-		}
-		else if (!strncmp(line, "Slab:", 5)) {
-			/* Read the amount of in-kernel data structures cache in kB */
-			sscanf(line + 5, "%lu", &st_memory->slabkb);
-		}
-		else if (!strncmp(line, "KernelStack:", 12)) {
-			/* Read the kernel stack utilization in kB */
-			sscanf(line + 12, "%lu", &st_memory->kstackkb);
-		}
-		else if (!strncmp(line, "PageTables:", 11)) {
-			/* Read the amount of memory dedicated to the lowest level of page tables in kB */
-			sscanf(line + 11, "%lu", &st_memory->pgtblkb);
-		}
-		else if (!strncmp(line, "VmallocUsed:", 12)) {
-			/* Read the amount of vmalloc area which is used in kB */
-			sscanf(line + 12, "%lu", &st_memory->vmusedkb);
+		/* Values are in kB */
+		if ((p = strchr(line, ':')) == NULL)
+			continue;
+		len = p - line;
+		if (len >= sizeof(fields[0].name))
+			continue;
+		for (i = 0; i < (int) (sizeof(fields) / sizeof(fields[0])); i++) {
+			if (!strncmp(line, fields[i].name, len) && !fields[i].name[len]) {
+				p++;
+				if (parse_proc_ull(&p, &v))
+					*(unsigned long *) ((char *) st_memory + fields[i].offset) = v;
+				break;
+			}
 		}
 	}
-
-	fclose(fp);
 }
 
 /*
  ***************************************************************************
  * Read machine uptime, independently of the number of processors.
  *
+ * IN:
+ * @pf		/proc/uptime file.
+ *
  * OUT:
  * @uptime	Uptime value in jiffies.
  ***************************************************************************
  */
-void read_uptime(unsigned long long *uptime)
+void read_uptime(struct proc_file *pf, unsigned long long *uptime)
 {
-	FILE *fp;
-	char line[128];
-	unsigned long up_sec, up_cent;
+	unsigned long long up_sec, up_cent = 0;
+	char *p;
 
-	if ((fp = fopen(UPTIME, "r")) == NULL)
+	if ((p = read_proc_file(pf)) == NULL)
 		return;
 
-	if (fgets(line, sizeof(line), fp) == NULL) {
-		fclose(fp);
+	/* "12345.67 ..." */
+	if (!parse_proc_ull(&p, &up_sec))
 		return;
+	if (*p == '.') {
+		p++;
+		parse_proc_ull(&p, &up_cent);
 	}
+	*uptime = up_sec * HZ + up_cent * HZ / 100;
+}
+
+/*
+ ***************************************************************************
+ * Read /proc/diskstats.
+ *
+ * IN:
+ * @pf		/proc/diskstats, kept open between calls.
+ *
+ * OUT:
+ * @ds		Snapshot of every device and partition. Its dev array is
+ *		grown as needed and reused on the next call.
+ *
+ * RETURNS:
+ * 0 on success, -1 on error.
+ ***************************************************************************
+ */
+int read_diskstats_snap(struct proc_file *pf, struct diskstats_snap *ds)
+{
+	struct diskstats_dev *d;
+	struct timespec ts;
+	unsigned long long major, minor;
+	char *text, *line, *p;
+	size_t len;
+	int n;
 
-	sscanf(line, "%lu.%lu", &up_sec, &up_cent);
-	*uptime = (unsigned long long) up_sec * HZ +
-	          (unsigned long long) up_cent * HZ / 100;
+	if ((text = read_proc_file(pf)) == NULL)
+		return -1;
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	ds->uptime_ms = ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
 
-	fclose(fp);
+	ds->nr_dev = 0;
+	for (line = text; line; line = next_proc_line(line)) {
+
+		/*
+		 * major minor name rio rmerge rsect ruse wio wmerge wsect wuse
+		 * running use aveq [dio dmerge dsect duse [fio fuse]]
+		 */
+		p = line;
+		if (!parse_proc_ull(&p, &major) || !parse_proc_ull(&p, &minor))
+			continue;
+		while (*p == ' ')
+			p++;
+		len = strcspn(p, " \n");
+		if (!len)
+			continue;
+
+		if (ds->nr_dev == ds->dev_alloc) {
+			n = ds->dev_alloc ? ds->dev_alloc * 2 : 32;
+			if ((d = realloc(ds->dev, n * sizeof(*d))) == NULL)
+				return -1;
+			ds->dev = d;
+			ds->dev_alloc = n;
+		}
+		d = ds->dev + ds->nr_dev;
+
+		d->major = major;
+		d->minor = minor;
+		if (len >= DISKSTATS_NAME_LEN)
+			len = DISKSTATS_NAME_LEN - 1;
+		memcpy(d->name, p, len);
+		d->name[len] = '\0';
+		p += strcspn(p, " \n");
+
+		/* Counters this kernel doesn't have are left zeroed */
+		memset(&d->rd_ios, 0, DISKSTATS_MAX_FIELDS * sizeof(d->rd_ios));
+		for (n = 0; (n < DISKSTATS_MAX_FIELDS) &&
+			    parse_proc_ull(&p, &d->rd_ios + n); n++);
+		d->nr_fields = n;
+		while ((n >= DISKSTATS_MAX_FIELDS) && parse_proc_ull(&p, &major))
+			d->nr_fields++;
+
+		if (n == 4) {
+			/* Partition without extended statistics: rio rsect wio wsect */
+			d->wr_sectors = d->rd_ticks;
+			d->wr_ios     = d->rd_sectors;
+			d->rd_sectors = d->rd_merges;
+			d->rd_merges  = d->rd_ticks = 0;
+		}
+		else if (n < DISKSTATS_NR_FIELDS)
+			/* Unknown entry: Ignore it */
+			continue;
+
+		ds->nr_dev++;
+	}
+
+	return 0;
+}
 
+/*
+ ***************************************************************************
+ * Difference between two readings of a /proc/diskstats counter. A counter
+ * that went down was reset (device removed and added again): count from
+ * zero.
+ ***************************************************************************
+ */
+static unsigned long long diskstats_delta(unsigned long long cur,
+					  unsigned long long prev)
+{
+	return (cur >= prev) ? cur - prev : cur;
+}
+
+/*
+ ***************************************************************************
+ * Same for the *_ticks counters, which the kernel prints as 32-bit
+ * millisecond values: those wrap every 49 days.
+ ***************************************************************************
+ */
+static unsigned long long diskstats_ticks_delta(unsigned long long cur,
+						unsigned long long prev)
+{
+	if ((cur < prev) && (prev <= 0xffffffffULL))
+		return cur + 0x100000000ULL - prev;
+	return diskstats_delta(cur, prev);
+}
+
+/*
+ ***************************************************************************
+ * Compute the extended statistics of a device over an interval. This only
+ * depends on its arguments, so any two snapshots of the same device can be
+ * used, whatever time apart.
+ *
+ * IN:
+ * @cur		Device at the end of the interval.
+ * @prev	Same device at the start of the interval, or NULL for an
+ *		interval starting at boot.
+ * @itv_ms	Interval length in milliseconds.
+ *
+ * OUT:
+ * @r		Extended statistics.
+ ***************************************************************************
+ */
+void compute_diskstats_rates(const struct diskstats_dev *cur,
+			     const struct diskstats_dev *prev,
+			     unsigned long long itv_ms, struct diskstats_rates *r)
+{
+	static const struct diskstats_dev zero;
+	struct stats_disk sdc, sdp;
+	struct ext_disk_stats xds;
+	unsigned long long rd_ios, wr_ios, rd_ticks, wr_ticks, dc_ios, fl_ios;
+	unsigned long long itv;
+	double sec;
+
+	if (!prev)
+		prev = &zero;
+	sec = itv_ms ? itv_ms / 1000.0 : 1.0;
+	/* compute_ext_disk_stats() wants the interval in jiffies */
+	itv = (itv_ms * HZ + 500) / 1000;
+	if (!itv)
+		itv = 1;
+
+#define DELTA(f)	diskstats_delta(cur->f, prev->f)
+#define TICKS(f)	diskstats_ticks_delta(cur->f, prev->f)
+	rd_ios   = DELTA(rd_ios);
+	wr_ios   = DELTA(wr_ios);
+	rd_ticks = TICKS(rd_ticks);
+	wr_ticks = TICKS(wr_ticks);
+
+	/*
+	 * util, await, svctm and arqsz are computed as iostat does, from the
+	 * deltas against a zeroed start so that wrapped counters give the
+	 * right result.
+	 */
+	memset(&sdc, 0, STATS_DISK_SIZE);
+	memset(&sdp, 0, STATS_DISK_SIZE);
+	sdc.nr_ios    = rd_ios + wr_ios;
+	sdc.rd_sect   = DELTA(rd_sectors);
+	sdc.wr_sect   = DELTA(wr_sectors);
+	sdc.rd_ticks  = rd_ticks;
+	sdc.wr_ticks  = wr_ticks;
+	sdc.tot_ticks = TICKS(tot_ticks);
+	compute_ext_disk_stats(&sdc, &sdp, itv, &xds);
+
+	r->rd_ios    = rd_ios / sec;
+	r->wr_ios    = wr_ios / sec;
+	r->rd_merges = DELTA(rd_merges) / sec;
+	r->wr_merges = DELTA(wr_merges) / sec;
+	/* Sectors are always 512 bytes in /proc/diskstats */
+	r->rd_kb     = sdc.rd_sect / 2.0 / sec;
+	r->wr_kb     = sdc.wr_sect / 2.0 / sec;
+
+	r->r_await = rd_ios ? (double) rd_ticks / rd_ios : 0.0;
+	r->w_await = wr_ios ? (double) wr_ticks / wr_ios : 0.0;
+	r->await   = xds.await;
+	r->arqsz   = xds.arqsz;
+	r->svctm   = xds.svctm;
+
+	/* Ticks are milliseconds: queue time per second */
+	r->aqu_sz = TICKS(rq_ticks) / 1000.0 / sec;
+	r->util   = xds.util / 10.0;
+	if (r->util > 100.0)
+		r->util = 100.0;
+
+	/* Discards and flushes are not counted in the reads and writes */
+	dc_ios    = DELTA(dc_ios);
+	fl_ios    = DELTA(fl_ios);
+	r->dc_ios    = dc_ios / sec;
+	r->dc_merges = DELTA(dc_merges) / sec;
+	r->dc_kb     = DELTA(dc_sectors) / 2.0 / sec;
+	r->fl_ios    = fl_ios / sec;
+	r->d_await = dc_ios ? (double) TICKS(dc_ticks) / dc_ios : 0.0;
+	r->f_await = fl_ios ? (double) TICKS(fl_ticks) / fl_ios : 0.0;
+#undef TICKS
+#undef DELTA
 }
 
 #ifdef SOURCE_SADC
@@ -19,6 +19,7 @@
 #include <sys/wait.h>
 #include <signal.h>
 #include "jsonrpc-c.h"
+#include "procstat.h"
 
 static int debug; /* enable this to printf */
 #define DEBUG_PRINT(fmt, args...) \
@@ -124,6 +125,18 @@ static builtin_func_info lookup_table[LOOKUP_TABLE_COUNT] = {
 		.func = COMMAND(mpstat),
 		.lock = &LOCK(sysstat),
 	},
+	{
+		.name = "diskstat",
+		.type = CMD_TYPE_BUILTIN,
+		.func = COMMAND(diskstat),
+		.lock = &LOCK(sysstat),
+	},
+	{
+		.name = "irqstat",
+		.type = CMD_TYPE_BUILTIN,
+		.func = COMMAND(irqstat),
+		.lock = &LOCK(sysstat),
+	},
 	{
 		.name = "free",
 		.type = CMD_TYPE_BUILTIN,
@@ -142,6 +155,12 @@ static builtin_func_info lookup_table[LOOKUP_TABLE_COUNT] = {
 		.func = COMMAND(procrank),
 		.lock = &LOCK(procrank),
 	},
+	{
+		.name = "librank",
+		.type = CMD_TYPE_BUILTIN,
+		.func = COMMAND(librank),
+		.lock = &LOCK(procrank),
+	},
 	{
 		.name = "iotop",
 		.type = CMD_TYPE_BUILTIN,
@@ -230,6 +249,14 @@ cJSON * read_proc(jrpc_context * ctx, cJSON * params, cJSON *id)
 	if (!ctx->data)
 		return NULL;
 
+	if (!strcmp(ctx->data, "stat")) {
+		/* the snapshot mpstat and top parse, at most a tick old */
+		if (procstat_text(proc_buff, PROC_BUFF - strlen(endstring)) < 0)
+			return NULL;
+		strcat(proc_buff, endstring);
+		return cJSON_CreateString(proc_buff);
+	}
+
 	builtin_func_info* info = lookup_func("proc");
 	snprintf(proc_path, 50, "/proc/%s", ctx->data);
 
@@ -280,6 +307,35 @@ cJSON * run_builtin_cmd(jrpc_context * ctx, cJSON * params, cJSON *id)
 
         }
 
+	/* {"limit": N} asks ps/top/irqstat to select and format only N rows */
+	char limit_buff[16];
+	cJSON *limit = params ? cJSON_GetObjectItem(params, "limit") : NULL;
+	if (limit && limit->type == cJSON_Number && limit->valueint > 0
+	    && (!strcmp(info->name, "ps") || !strcmp(info->name, "top")
+		|| !strcmp(info->name, "irqstat"))
+	    && argc < MAX_CMD_ARGV - 2) {
+		snprintf(limit_buff, sizeof(limit_buff), "%d", limit->valueint);
+		argv[argc++] = "--top";
+		argv[argc++] = limit_buff;
+	}
+
+	/* {"window": N} asks diskstat for the stats of the last N seconds */
+	char window_buff[16];
+	cJSON *window = params ? cJSON_GetObjectItem(params, "window") : NULL;
+	if (window && window->type == cJSON_Number && window->valueint > 0
+	    && !strcmp(info->name, "diskstat") && argc < MAX_CMD_ARGV - 2) {
+		snprintf(window_buff, sizeof(window_buff), "%d", window->valueint);
+		argv[argc++] = "-w";
+		argv[argc++] = window_buff;
+	}
+
+	/* {"queues": true} adds diskstat's per hardware queue lines */
+	cJSON *queues = params ? cJSON_GetObjectItem(params, "queues") : NULL;
+	if (queues && queues->type == cJSON_True
+	    && !strcmp(info->name, "diskstat") && argc < MAX_CMD_ARGV - 1) {
+		argv[argc++] = "-q";
+	}
+
 	argv[argc] = NULL;;
 	if(info->func != NULL){
 		pthread_mutex_lock(info->lock);
@@ -458,11 +514,17 @@ int main(int argc, char **argv)
 	//jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdIopp", "iopp");
 	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdFree", "free");
 	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdProcrank", "procrank");
+	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdProcrankFast", "procrank -S");
+	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdProcrankIdle", "procrank -I");
+	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdLibrank", "librank");
+	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdVmarank", "librank -V");
 	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdIostat", "iostat -d -x -k");
+	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdDiskstat", "diskstat");
 	//jrpc_register_procedure(&my_server, run_cmd, "GetCmdVmstat", "vmstat");
 	//jrpc_register_procedure(&my_server, run_cmd, "GetCmdTop", "top -n 1 -b | head -n 50");
 	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdTop", "ps -e -o pid,user,pri,ni,vsize,rss,s,%cpu,%mem,time,cmd --sort=-%cpu ");
-	//jrpc_register_procedure(&my_server, run_cmd, "GetCmdTopH", "top -n 1 -b | head -n 50");
+	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdTopH", "ps -e H -o pid,tid,user,s,psr,%cpu,vcsw,ivcsw,wchan:20,comm --sort=-%cpu ");
+	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdTopMem", "top -b -m");
 	//jrpc_register_procedure(&my_server, run_cmd, "GetCmdIotop", "iotop -n 1 -b | head -n 50");
 	//jrpc_register_procedure(&my_server, run_cmd, "GetCmdSmem", "smem -p -s pss -r -n 50");
 	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdDmesg", "dmesg");
@@ -470,6 +532,7 @@ int main(int argc, char **argv)
 	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCpuInfo", "cpuinfo");
 	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdMpstat", "mpstat -P ALL 1 1");
 	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdMpstat-I", "mpstat -I ALL 1 1");
+	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdIrqStat", "irqstat");
 	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdIrqInfo", "irq_info");
 	jrpc_register_procedure(&my_server, run_builtin_cmd, "GetCmdCgtop", "cgtop");
 
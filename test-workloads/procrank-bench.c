@@ -0,0 +1,53 @@
+/*
+ * compare procrank's pagemap walk with its smaps_rollup mode
+ *
+ * build after "make" in the top directory:
+ *   gcc procrank-bench.c ../libs/libprocrank.a ../libs/libcommon.a -lpthread -o procrank-bench
+ * then run it as root, ideally with malloc/load-sim instances busy:
+ *   ./procrank-bench [rounds]
+ *
+ * Licensed under GPLv2 or later.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+int procrank_main(int argc, char **argv, int fd);
+
+static double run(char *mode, int rounds)
+{
+	char *argv[] = { "procrank", mode, NULL };
+	struct timespec start, end;
+	int i, fd;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < rounds; i++) {
+		/* procrank_main closes the fd it is given */
+		fd = open("/dev/null", O_WRONLY);
+		procrank_main(2, argv, fd);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1e3 +
+		(end.tv_nsec - start.tv_nsec) / 1e6) / rounds;
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 10;
+
+	if (rounds <= 0)
+		rounds = 10;
+
+	/* mute the per-pid warnings of both modes */
+	freopen("/dev/null", "w", stderr);
+
+	/* -f: walk every process, so the cross-run cache does not help */
+	printf("pagemap (-f): %8.2f ms/run\n", run("-f", rounds));
+	printf("rollup  (-S): %8.2f ms/run\n", run("-S", rounds));
+
+	return 0;
+}